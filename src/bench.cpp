@@ -0,0 +1,386 @@
+// Throughput benchmark for combine, convert and count over synthetic
+// inputs of increasing width and depth. Each run is forked so its peak RSS
+// is its own, and results are written as JSON, one run per line, which is
+// also the format read back as a baseline.
+#include <fcntl.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <filesystem>
+#include <format>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+#include "CLI11.hpp"
+#include "cross.h"
+#include "simulate.h"
+#include "stats.h"
+#include "utils.h"
+#include "vcf.h"
+
+namespace
+{
+namespace fs = std::filesystem;
+
+struct Result
+{
+    std::string name;
+    size_t samples = 0;
+    size_t sites = 0;
+    size_t threads = 0;
+    double seconds = 0;
+    double records_per_s = 0;
+    double genotypes_per_s = 0;
+    double mb_in_per_s = 0;
+    double mb_out_per_s = 0;
+    double peak_rss_mb = 0;
+
+    auto key() const { return std::tie(name, samples, sites, threads); }
+};
+
+struct Run
+{
+    double seconds;
+    double peak_rss_mb;
+};
+
+// Runs fn in a child process with its progress output discarded.
+Run run_forked(const std::function<void()>& fn)
+{
+    std::cout.flush();
+    auto start = std::chrono::steady_clock::now();
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        throw std::runtime_error("fork failed");
+    }
+    if (pid == 0)
+    {
+        int err = dup(STDERR_FILENO);
+        int null = open("/dev/null", O_WRONLY);
+        dup2(null, STDOUT_FILENO);
+        dup2(null, STDERR_FILENO);
+        try
+        {
+            fn();
+        }
+        catch (const std::exception& e)
+        {
+            dprintf(err, "Error: %s\n", e.what());
+            _exit(1);
+        }
+        _exit(0);
+    }
+    int status = 0;
+    rusage usage{};
+    wait4(pid, &status, 0, &usage);
+    std::chrono::duration<double> elapsed
+        = std::chrono::steady_clock::now() - start;
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0)
+    {
+        throw std::runtime_error("Benchmark run failed");
+    }
+    // ru_maxrss is in KiB on Linux
+    return {elapsed.count(), static_cast<double>(usage.ru_maxrss) / 1024.};
+}
+
+double file_mb(const fs::path& path)
+{
+    std::error_code ec;
+    auto size = fs::file_size(path, ec);
+    return ec ? 0. : static_cast<double>(size) / (1024. * 1024.);
+}
+
+std::string to_json(const Result& r)
+{
+    return std::format(
+        "{{\"name\": \"{}\", \"samples\": {}, \"sites\": {}, "
+        "\"threads\": {}, \"seconds\": {:.6g}, \"records_per_s\": {:.6g}, "
+        "\"genotypes_per_s\": {:.6g}, \"mb_in_per_s\": {:.6g}, "
+        "\"mb_out_per_s\": {:.6g}, \"peak_rss_mb\": {:.6g}}}",
+        r.name,
+        r.samples,
+        r.sites,
+        r.threads,
+        r.seconds,
+        r.records_per_s,
+        r.genotypes_per_s,
+        r.mb_in_per_s,
+        r.mb_out_per_s,
+        r.peak_rss_mb);
+}
+
+// Reads back the fields to_json writes; not a general JSON parser.
+std::string field(const std::string& line, const std::string& key)
+{
+    std::string tag = "\"" + key + "\": ";
+    auto at = line.find(tag);
+    if (at == std::string::npos)
+    {
+        return "";
+    }
+    at += tag.size();
+    if (line[at] == '"')
+    {
+        return line.substr(at + 1, line.find('"', at + 1) - at - 1);
+    }
+    return line.substr(at, line.find_first_of(",}", at) - at);
+}
+
+std::vector<Result> read_baseline(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open baseline file: " + path);
+    }
+    std::vector<Result> results;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.find("\"name\"") == std::string::npos)
+        {
+            continue;
+        }
+        Result r;
+        r.name = field(line, "name");
+        r.samples = std::stoull(field(line, "samples"));
+        r.sites = std::stoull(field(line, "sites"));
+        r.threads = std::stoull(field(line, "threads"));
+        r.genotypes_per_s = std::stod(field(line, "genotypes_per_s"));
+        r.peak_rss_mb = std::stod(field(line, "peak_rss_mb"));
+        results.push_back(r);
+    }
+    return results;
+}
+
+std::vector<size_t> thread_counts(size_t max_threads)
+{
+    std::vector<size_t> counts;
+    for (size_t t = 1; t < max_threads; t *= 2)
+    {
+        counts.push_back(t);
+    }
+    counts.push_back(max_threads);
+    return counts;
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    CLI::App app{"Throughput benchmark for vcfbox subcommands"};
+    argv = app.ensure_utf8(argv);
+    std::vector<size_t> widths = {100, 1000};
+    std::vector<size_t> depths = {10'000, 100'000};
+    size_t max_threads = std::max(1U, std::thread::hardware_concurrency());
+    std::string workdir = "vcfbox_bench.tmp";
+    std::string output = "bench.json";
+    std::string baseline;
+    double threshold = 0.1;
+    app.add_option("--samples", widths, "Input widths to run.")
+        ->delimiter(',')
+        ->capture_default_str();
+    app.add_option("--sites", depths, "Input depths to run.")
+        ->delimiter(',')
+        ->capture_default_str();
+    app.add_option(
+           "-t,--threads",
+           max_threads,
+           "Largest thread count, threaded runs sweep powers of two up to it.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    app.add_option("--workdir", workdir, "Directory for generated files.")
+        ->capture_default_str();
+    app.add_option("-o,--output", output, "Path to output JSON.")
+        ->capture_default_str();
+    app.add_option(
+        "--baseline", baseline, "JSON of an earlier run to compare against.");
+    app.add_option(
+           "--threshold",
+           threshold,
+           "Relative slowdown or RSS growth reported as a regression.")
+        ->capture_default_str()
+        ->check(CLI::Range(0., 1.));
+    CLI11_PARSE(app, argc, argv);
+
+    try
+    {
+        std::vector<Result> previous;
+        if (!baseline.empty())
+        {
+            previous = read_baseline(baseline);
+        }
+        fs::create_directories(workdir);
+        std::vector<Result> results;
+        auto record = [&](Result r, const Run& run, const fs::path& in,
+                          const fs::path& out)
+        {
+            r.seconds = run.seconds;
+            r.records_per_s = static_cast<double>(r.sites) / run.seconds;
+            r.genotypes_per_s
+                = static_cast<double>(r.sites * r.samples) / run.seconds;
+            r.mb_in_per_s = file_mb(in) / run.seconds;
+            r.mb_out_per_s = file_mb(out) / run.seconds;
+            r.peak_rss_mb = run.peak_rss_mb;
+            std::cout << to_json(r) << '\n';
+            results.push_back(r);
+        };
+
+        for (size_t n_samples : widths)
+        {
+            for (size_t n_sites : depths)
+            {
+                auto stem = fs::path(workdir)
+                            / std::format("s{}_n{}", n_samples, n_sites);
+                fs::path in = stem.string() + ".bcf";
+                detail::SimulateOptions options;
+                options.n_samples = n_samples;
+                options.n_sites = n_sites;
+                options.n_contigs = 4;
+                run_forked(
+                    [&]()
+                    {
+                        vcfbox::simulate_vcf(in.string(), options, max_threads);
+                        // an index lets count shard by region
+                        if (bcf_index_build3(
+                                in.c_str(),
+                                nullptr,
+                                14,
+                                static_cast<int>(max_threads))
+                            != 0)
+                        {
+                            throw std::runtime_error(
+                                "Failed to index " + in.string());
+                        }
+                    });
+                fs::path pairs = stem.string() + ".pairs";
+                {
+                    std::ofstream file(pairs);
+                    for (size_t i = 1; i + 1 <= n_samples; i += 2)
+                    {
+                        file << std::format("S{}\tS{}\n", i, i + 1);
+                    }
+                }
+
+                Result base;
+                base.samples = n_samples;
+                base.sites = n_sites;
+                base.threads = 1;
+
+                fs::path out = stem.string() + ".combined.bcf";
+                base.name = "combine";
+                auto run = run_forked(
+                    [&]()
+                    {
+                        vcfbox::combine_genotypes(
+                            in.string(),
+                            detail::CrossDesign::from_pairs(
+                                vcfbox::parse_sample_pairs(pairs.string())),
+                            false,
+                            false,
+                            out.string(),
+                            "",
+                            {},
+                            {},
+                            vcfbox::parse_mode(out.string()));
+                    });
+                record(base, run, in, out);
+
+                out = stem.string() + ".hmp";
+                base.name = "convert";
+                run = run_forked(
+                    [&]() { vcfbox::to_hapmap(in.string(), out.string()); });
+                record(base, run, in, out);
+
+                out = stem.string() + ".count.tsv";
+                base.name = "count";
+                for (size_t threads : thread_counts(max_threads))
+                {
+                    base.threads = threads;
+                    run = run_forked(
+                        [&]()
+                        {
+                            vcfbox::count_stats(
+                                in.string(), out.string(), true, threads);
+                        });
+                    record(base, run, in, out);
+                }
+            }
+        }
+
+        std::ofstream stream(output);
+        if (!stream)
+        {
+            throw std::runtime_error("Failed to open output file: " + output);
+        }
+        stream << "{\"results\": [\n";
+        for (size_t i = 0; i < results.size(); ++i)
+        {
+            stream << "  " << to_json(results[i])
+                   << (i + 1 < results.size() ? ",\n" : "\n");
+        }
+        stream << "]}\n";
+
+        if (baseline.empty())
+        {
+            return 0;
+        }
+        std::map<decltype(results[0].key()), const Result*> current;
+        for (const auto& r : results)
+        {
+            current.emplace(r.key(), &r);
+        }
+        size_t regressions = 0;
+        for (const auto& old : previous)
+        {
+            auto it = current.find(old.key());
+            if (it == current.end())
+            {
+                continue;
+            }
+            const Result& now = *it->second;
+            bool slower
+                = now.genotypes_per_s < old.genotypes_per_s * (1 - threshold);
+            bool bigger = now.peak_rss_mb > old.peak_rss_mb * (1 + threshold);
+            if (slower || bigger)
+            {
+                regressions++;
+                std::cout << std::format(
+                    "REGRESSION {} samples={} sites={} threads={}: "
+                    "{:.4g} -> {:.4g} genotypes/s, {:.4g} -> {:.4g} MB RSS\n",
+                    now.name,
+                    now.samples,
+                    now.sites,
+                    now.threads,
+                    old.genotypes_per_s,
+                    now.genotypes_per_s,
+                    old.peak_rss_mb,
+                    now.peak_rss_mb);
+            }
+        }
+        return regressions == 0 ? 0 : 2;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+}
@@ -0,0 +1,241 @@
+// Microbenchmarks for the per-record kernels of combine and convert, run on
+// synthetic records held in memory so no decompression or disk I/O ends up
+// in the timings. Each kernel is called over the record set until it has
+// run for --min-time, and reported per record and per genotype it emits.
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <iostream>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+#include "CLI11.hpp"
+#include "cross.h"
+#include "utils.h"
+#include "vcf.h"
+#include "vcf_raii.h"
+
+namespace
+{
+// Diploid calls at fixed missing and het rates, hom calls split evenly
+// between the two alleles.
+std::vector<int32_t> synthetic_gts(
+    size_t n_records,
+    size_t n_samples,
+    std::mt19937_64& rng)
+{
+    std::uniform_real_distribution<double> u(0., 1.);
+    std::vector<int32_t> gts(n_records * n_samples * 2);
+    for (size_t i = 0; i < n_records * n_samples; ++i)
+    {
+        double x = u(rng);
+        int32_t a0 = x < .5 ? 0 : 1;
+        int32_t a1 = a0;
+        if (x < .01)
+        {
+            gts[2 * i] = bcf_gt_missing;
+            gts[(2 * i) + 1] = bcf_gt_missing;
+            continue;
+        }
+        if (x > .98)
+        {
+            a0 = 0;
+            a1 = 1;
+        }
+        gts[2 * i] = bcf_gt_unphased(a0);
+        gts[(2 * i) + 1] = bcf_gt_unphased(a1);
+    }
+    return gts;
+}
+
+// Calls fn(record) round-robin over the records, doubling the number of
+// calls until a batch takes at least `min_time` seconds. Returns ns/call.
+template <typename Fn>
+double time_kernel(size_t n_records, double min_time, Fn&& fn)
+{
+    for (size_t n_calls = n_records;; n_calls *= 2)
+    {
+        auto start = std::chrono::steady_clock::now();
+        for (size_t k = 0; k < n_calls; ++k)
+        {
+            fn(k % n_records);
+        }
+        std::chrono::duration<double> elapsed
+            = std::chrono::steady_clock::now() - start;
+        if (elapsed.count() >= min_time)
+        {
+            return elapsed.count() * 1e9 / static_cast<double>(n_calls);
+        }
+    }
+}
+
+void report(
+    const std::string& kernel,
+    size_t n_samples,
+    size_t n_pairs,
+    double ns_record,
+    size_t genotypes)
+{
+    std::string per_genotype = "NA";
+    if (genotypes > 0)
+    {
+        per_genotype
+            = std::format("{:.3f}", ns_record / static_cast<double>(genotypes));
+    }
+    std::cout << std::format(
+        "{}\t{}\t{}\t{:.1f}\t{}\n",
+        kernel,
+        n_samples,
+        n_pairs,
+        ns_record,
+        per_genotype);
+}
+
+}  // namespace
+
+int main(int argc, char** argv)
+{
+    CLI::App app{"Microbenchmarks for the per-record kernels"};
+    argv = app.ensure_utf8(argv);
+    std::vector<size_t> widths = {100, 1000, 10'000};
+    std::vector<size_t> pair_counts = {10, 100, 1000};
+    size_t n_records = 256;
+    double min_time = 0.2;
+    uint64_t seed = 1;
+    app.add_option("--samples", widths, "Input sample counts to run.")
+        ->delimiter(',')
+        ->capture_default_str();
+    app.add_option("--pairs", pair_counts, "Cross counts to run.")
+        ->delimiter(',')
+        ->capture_default_str();
+    app.add_option("--records", n_records, "Synthetic records kept in memory.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    app.add_option(
+           "--min-time", min_time, "Seconds each measurement runs for.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    app.add_option("--seed", seed, "Random seed.")->capture_default_str();
+    CLI11_PARSE(app, argc, argv);
+
+    try
+    {
+        std::mt19937_64 rng(seed);
+        std::cout << "kernel\tsamples\tpairs\tns_per_record\tns_per_genotype\n";
+        for (size_t n_samples : widths)
+        {
+            if (n_samples < 2)
+            {
+                throw std::runtime_error("Need at least two samples");
+            }
+            BcfHdr header(bcf_hdr_init("w"));
+            bcf_hdr_append(header.get(), "##contig=<ID=chr1>");
+            bcf_hdr_append(
+                header.get(),
+                "##FORMAT=<ID=GT,Number=1,Type=String,"
+                "Description=\"Genotype\">");
+            for (size_t i = 0; i < n_samples; ++i)
+            {
+                bcf_hdr_add_sample(
+                    header.get(), std::format("S{}", i + 1).c_str());
+            }
+            bcf_hdr_add_sample(header.get(), nullptr);
+
+            auto gts = synthetic_gts(n_records, n_samples, rng);
+            auto n_gt = static_cast<int>(2 * n_samples);
+            auto site
+                = [&](size_t r) { return gts.data() + (r * 2 * n_samples); };
+
+            std::string calls;
+            double ns = time_kernel(
+                n_records,
+                min_time,
+                [&](size_t r)
+                {
+                    calls.clear();
+                    detail::append_hapmap_calls(
+                        calls, site(r), n_gt, "A", "G");
+                });
+            report("hapmap_calls", n_samples, 0, ns, n_samples);
+
+            for (size_t n_pairs : pair_counts)
+            {
+                std::uniform_int_distribution<size_t> pick(0, n_samples - 1);
+                std::vector<detail::SamplePair> pairs;
+                for (size_t k = 0; k < n_pairs; ++k)
+                {
+                    size_t a = pick(rng);
+                    size_t b = pick(rng);
+                    b = b == a ? (a + 1) % n_samples : b;
+                    pairs.emplace_back(
+                        std::format("S{}", a + 1), std::format("S{}", b + 1));
+                }
+                auto design = detail::CrossDesign::from_pairs(pairs);
+                design.bind(header.get());
+
+                std::vector<int32_t> out_gts;
+                for (bool keep : {false, true})
+                {
+                    ns = time_kernel(
+                        n_records,
+                        min_time,
+                        [&](size_t r)
+                        {
+                            detail::concat_gt(
+                                design, site(r), keep, n_gt, out_gts);
+                        });
+                    report(
+                        keep ? "concat_gt_keep" : "concat_gt",
+                        n_samples,
+                        n_pairs,
+                        ns,
+                        n_pairs + (keep ? n_samples : 0));
+                }
+
+                // copy_rec_info does not touch the calls, but its output
+                // header carries the crosses as it would in combine
+                BcfHdr output_header(
+                    detail::init_bcf_head(header.get(), design, false));
+                std::vector<BcfRec> recs;
+                for (size_t r = 0; r < n_records; ++r)
+                {
+                    recs.emplace_back(bcf_init());
+                    bcf1_t* rec = recs.back().get();
+                    rec->rid = 0;
+                    rec->pos = static_cast<hts_pos_t>(r * 100);
+                    bcf_float_set_missing(rec->qual);
+                    bcf_update_id(
+                        header.get(), rec, std::format("rs{}", r).c_str());
+                    bcf_update_alleles_str(header.get(), rec, "A,G");
+                }
+                BcfRec out_rec(bcf_init());
+                ns = time_kernel(
+                    n_records,
+                    min_time,
+                    [&](size_t r)
+                    {
+                        detail::copy_rec_info(
+                            header.get(),
+                            output_header.get(),
+                            recs[r].get(),
+                            out_rec.get());
+                    });
+                report("copy_rec_info", n_samples, n_pairs, ns, 0);
+            }
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error: " << e.what() << '\n';
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,203 @@
+#include "cache.h"
+
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <optional>
+#include <sstream>
+#include <string>
+
+#include "vcf_raii.h"
+
+namespace detail
+{
+namespace
+{
+constexpr const char* kMetaMagic = "vcfbox-meta\t1";
+// last line of a complete sidecar, so a truncated one is never trusted
+constexpr const char* kMetaEnd = "end";
+
+uint64_t fnv1a(const char* data, size_t n)
+{
+    uint64_t hash = 0xcbf29ce484222325ULL;
+    for (size_t i = 0; i < n; ++i)
+    {
+        hash ^= static_cast<unsigned char>(data[i]);
+        hash *= 0x100000001b3ULL;
+    }
+    return hash;
+}
+
+}  // namespace
+
+std::string meta_path(const std::string& vcf_path)
+{
+    return vcf_path + ".vcfbox.meta";
+}
+
+uint64_t hash_header(bcf_hdr_t* header)
+{
+    KString text;
+    if (bcf_hdr_format(header, 0, &text.s_) != 0)
+    {
+        return 0;
+    }
+    return fnv1a(text.s_.s, text.s_.l);
+}
+
+std::optional<FileFingerprint> fingerprint(
+    const std::string& vcf_path,
+    bcf_hdr_t* header)
+{
+    struct stat st{};
+    if (vcf_path == "-" || stat(vcf_path.c_str(), &st) != 0
+        || !S_ISREG(st.st_mode))
+    {
+        return std::nullopt;
+    }
+    return FileFingerprint{
+        .size = static_cast<uint64_t>(st.st_size),
+        .mtime_ns = static_cast<int64_t>(st.st_mtim.tv_sec) * 1'000'000'000
+                    + st.st_mtim.tv_nsec,
+        .inode = static_cast<uint64_t>(st.st_ino),
+        .header_hash = hash_header(header),
+    };
+}
+
+std::optional<FileMeta> load_meta(
+    const std::string& vcf_path,
+    const FileFingerprint& expected)
+{
+    std::ifstream file(meta_path(vcf_path));
+    if (!file)
+    {
+        return std::nullopt;
+    }
+    std::string line;
+    if (!std::getline(file, line) || line != kMetaMagic)
+    {
+        return std::nullopt;
+    }
+
+    FileMeta meta;
+    bool has_records = false;
+    bool complete = false;
+    while (std::getline(file, line))
+    {
+        if (complete)
+        {
+            return std::nullopt;
+        }
+        if (line == kMetaEnd)
+        {
+            complete = true;
+            continue;
+        }
+        auto tab = line.find('\t');
+        if (tab == std::string::npos)
+        {
+            return std::nullopt;
+        }
+        std::string key = line.substr(0, tab);
+        std::string value = line.substr(tab + 1);
+        std::istringstream iss(value);
+        if (key == "size")
+        {
+            iss >> meta.fingerprint.size;
+        }
+        else if (key == "mtime")
+        {
+            iss >> meta.fingerprint.mtime_ns;
+        }
+        else if (key == "inode")
+        {
+            iss >> meta.fingerprint.inode;
+        }
+        else if (key == "header")
+        {
+            iss >> std::hex >> meta.fingerprint.header_hash;
+        }
+        else if (key == "records")
+        {
+            iss >> meta.n_records;
+            has_records = true;
+        }
+        else if (key == "contig")
+        {
+            std::string name;
+            size_t count = 0;
+            iss >> name >> count;
+            meta.contig_records.emplace_back(name, count);
+        }
+        else if (key == "sample")
+        {
+            meta.samples.push_back(value);
+            continue;
+        }
+        if (iss.fail())
+        {
+            return std::nullopt;
+        }
+    }
+
+    if (!complete || !has_records || meta.fingerprint != expected)
+    {
+        return std::nullopt;
+    }
+    return meta;
+}
+
+void save_meta(const std::string& vcf_path, const FileMeta& meta)
+{
+    // write to a temporary of this writer's own and rename, so neither a
+    // concurrent reader nor a concurrent writer sees a half-written sidecar
+    std::string path = meta_path(vcf_path);
+    std::string tmp_path = path + ".XXXXXX";
+    int fd = mkstemp(tmp_path.data());
+    if (fd < 0)
+    {
+        return;
+    }
+    // mkstemp creates 0600, a sidecar next to a shared panel should be
+    // readable by everyone who can read the panel
+    fchmod(fd, S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+    close(fd);
+    {
+        std::ofstream file(tmp_path);
+        if (!file)
+        {
+            std::remove(tmp_path.c_str());
+            return;
+        }
+        file << kMetaMagic << "\n";
+        file << "size\t" << meta.fingerprint.size << "\n";
+        file << "mtime\t" << meta.fingerprint.mtime_ns << "\n";
+        file << "inode\t" << meta.fingerprint.inode << "\n";
+        file << "header\t" << std::hex << meta.fingerprint.header_hash
+             << std::dec << "\n";
+        file << "records\t" << meta.n_records << "\n";
+        for (const auto& [name, count] : meta.contig_records)
+        {
+            file << "contig\t" << name << "\t" << count << "\n";
+        }
+        for (const auto& sample : meta.samples)
+        {
+            file << "sample\t" << sample << "\n";
+        }
+        file << kMetaEnd << "\n";
+        if (!file)
+        {
+            std::remove(tmp_path.c_str());
+            return;
+        }
+    }
+    if (std::rename(tmp_path.c_str(), path.c_str()) != 0)
+    {
+        std::remove(tmp_path.c_str());
+    }
+}
+
+}  // namespace detail
@@ -0,0 +1,55 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+// Identifies one immutable version of an input file. Any change in size,
+// mtime, inode or header text invalidates the sidecar.
+struct FileFingerprint
+{
+    uint64_t size = 0;
+    int64_t mtime_ns = 0;
+    uint64_t inode = 0;
+    uint64_t header_hash = 0;
+
+    bool operator==(const FileFingerprint&) const = default;
+};
+
+// What we learn from one full scan of a VCF/BCF, persisted next to it as
+// `<file>.vcfbox.meta` so repeat runs on a reference panel skip the scan.
+struct FileMeta
+{
+    FileFingerprint fingerprint;
+    size_t n_records = 0;
+    std::vector<std::pair<std::string, size_t>> contig_records;
+    std::vector<std::string> samples;
+};
+
+std::string meta_path(const std::string& vcf_path);
+
+uint64_t hash_header(bcf_hdr_t* header);
+
+// Returns nullopt for streams and remote files, which cannot be cached.
+std::optional<FileFingerprint> fingerprint(
+    const std::string& vcf_path,
+    bcf_hdr_t* header);
+
+// Returns the cached metadata only if its fingerprint still matches.
+std::optional<FileMeta> load_meta(
+    const std::string& vcf_path,
+    const FileFingerprint& expected);
+
+// Best effort, an unwritable directory just means no cache.
+void save_meta(const std::string& vcf_path, const FileMeta& meta);
+
+}  // namespace detail
@@ -0,0 +1,185 @@
+#include "cross.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "utils.h"
+
+namespace detail
+{
+CrossDesign::CrossDesign(
+    Kind kind,
+    std::vector<std::string> first,
+    std::vector<std::string> second)
+    : kind_(kind), first_(std::move(first)), second_(std::move(second))
+{
+}
+
+CrossDesign CrossDesign::from_pairs(const std::vector<SamplePair>& pairs)
+{
+    std::vector<std::string> first;
+    std::vector<std::string> second;
+    first.reserve(pairs.size());
+    second.reserve(pairs.size());
+    for (const auto& [female, male] : pairs)
+    {
+        first.push_back(female);
+        second.push_back(male);
+    }
+    return {Kind::kPairs, std::move(first), std::move(second)};
+}
+
+CrossDesign CrossDesign::factorial(
+    std::vector<std::string> females,
+    std::vector<std::string> males)
+{
+    return {Kind::kFactorial, std::move(females), std::move(males)};
+}
+
+CrossDesign CrossDesign::half_diallel(std::vector<std::string> parents)
+{
+    std::vector<std::string> second = parents;
+    return {Kind::kHalfDiallel, std::move(parents), std::move(second)};
+}
+
+CrossDesign CrossDesign::full_diallel(std::vector<std::string> parents)
+{
+    std::vector<std::string> second = parents;
+    return {Kind::kFullDiallel, std::move(parents), std::move(second)};
+}
+
+void CrossDesign::exclude(const std::vector<std::string>& samples)
+{
+    std::set<std::string> excluded(samples.begin(), samples.end());
+    auto dropped = [&](const std::string& name)
+    { return excluded.contains(name); };
+    if (kind_ == Kind::kPairs)
+    {
+        // the lists are parallel here, so pairs are dropped in lockstep
+        size_t kept = 0;
+        for (size_t k = 0; k < first_.size(); ++k)
+        {
+            if (dropped(first_[k]) || dropped(second_[k]))
+            {
+                continue;
+            }
+            // a self-move would leave the names empty
+            if (kept != k)
+            {
+                first_[kept] = std::move(first_[k]);
+                second_[kept] = std::move(second_[k]);
+            }
+            kept++;
+        }
+        first_.resize(kept);
+        second_.resize(kept);
+        return;
+    }
+    std::erase_if(first_, dropped);
+    std::erase_if(second_, dropped);
+}
+
+void CrossDesign::bind(bcf_hdr_t* header)
+{
+    // one lookup over both lists, so the error names every missing sample
+    std::vector<std::string> names = first_;
+    names.insert(names.end(), second_.begin(), second_.end());
+    first_samples_ = resolve_samples(header, names);
+    second_samples_.assign(
+        first_samples_.begin() + static_cast<ptrdiff_t>(first_.size()),
+        first_samples_.end());
+    first_samples_.resize(first_.size());
+}
+
+size_t CrossDesign::size() const
+{
+    size_t n = first_.size();
+    switch (kind_)
+    {
+        case Kind::kPairs:
+            return n;
+        case Kind::kFactorial:
+            return n * second_.size();
+        case Kind::kHalfDiallel:
+            return n < 2 ? 0 : n * (n - 1) / 2;
+        case Kind::kFullDiallel:
+            return n < 2 ? 0 : n * (n - 1);
+    }
+    return 0;
+}
+
+CrossSummary::CrossSummary(size_t n_crosses)
+    : called_(n_crosses), het_(n_crosses)
+{
+}
+
+void CrossSummary::add(const int32_t* cross_gts)
+{
+    n_sites_++;
+    for (size_t k = 0; k < called_.size(); ++k)
+    {
+        int32_t female = cross_gts[2 * k];
+        int32_t male = cross_gts[(2 * k) + 1];
+        // combine writes a cross as both calls missing or neither
+        bool called = !bcf_gt_is_missing(female);
+        called_[k] += called ? 1 : 0;
+        het_[k] += called && bcf_gt_allele(female) != bcf_gt_allele(male)
+                       ? 1
+                       : 0;
+    }
+}
+
+void CrossSummary::write(const std::string& path, const CrossDesign& design)
+    const
+{
+    std::ofstream stream(path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + path);
+    }
+    auto ratio = [](std::string& out, size_t num, size_t den)
+    {
+        if (den == 0)
+        {
+            out += "\tNA";
+            return;
+        }
+        std::format_to(
+            std::back_inserter(out),
+            "\t{:.6g}",
+            static_cast<double>(num) / static_cast<double>(den));
+    };
+    stream << "hybrid\tfemale\tmale\tn_sites\tn_called\tcall_rate\tn_het\t"
+              "het_rate\n";
+    std::string line;
+    size_t k = 0;
+    design.for_each(
+        [&](size_t i, size_t j)
+        {
+            const auto& female = design.first_name(i);
+            const auto& male = design.second_name(j);
+            line = std::format(
+                "{}~{}\t{}\t{}\t{}\t{}",
+                female,
+                male,
+                female,
+                male,
+                n_sites_,
+                called_[k]);
+            ratio(line, called_[k], n_sites_);
+            std::format_to(std::back_inserter(line), "\t{}", het_[k]);
+            ratio(line, het_[k], called_[k]);
+            stream << line << '\n';
+            k++;
+        });
+}
+
+}  // namespace detail
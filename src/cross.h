@@ -0,0 +1,126 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+using SamplePair = std::pair<std::string, std::string>;
+
+// The crosses combine emits, described by the plan rather than listed:
+// an explicit pairs file, a full factorial between two lists, or a half
+// (i < j) or full (i != j, reciprocals included) diallel over one list.
+// Crosses are enumerated on the fly as positions in the parent lists, so a
+// million-hybrid factorial costs two short name lists, not a million
+// string pairs.
+class CrossDesign
+{
+   public:
+    static CrossDesign from_pairs(const std::vector<SamplePair>& pairs);
+    static CrossDesign factorial(
+        std::vector<std::string> females,
+        std::vector<std::string> males);
+    static CrossDesign half_diallel(std::vector<std::string> parents);
+    static CrossDesign full_diallel(std::vector<std::string> parents);
+
+    // Drops every cross with a parent in `samples`; call before bind().
+    void exclude(const std::vector<std::string>& samples);
+
+    // Resolves every parent name to its sample index in `header`, listing
+    // all names it does not contain in the error.
+    void bind(bcf_hdr_t* header);
+
+    size_t size() const;
+    int first_sample(size_t i) const { return first_samples_[i]; }
+    int second_sample(size_t j) const { return second_samples_[j]; }
+    const std::string& first_name(size_t i) const { return first_[i]; }
+    const std::string& second_name(size_t j) const { return second_[j]; }
+
+    // Calls fn(i, j) for every cross in output order, i indexing the first
+    // parent list and j the second.
+    template <typename Fn>
+    void for_each(Fn&& fn) const
+    {
+        switch (kind_)
+        {
+            case Kind::kPairs:
+                for (size_t k = 0; k < first_.size(); ++k)
+                {
+                    fn(k, k);
+                }
+                break;
+            case Kind::kFactorial:
+                for (size_t i = 0; i < first_.size(); ++i)
+                {
+                    for (size_t j = 0; j < second_.size(); ++j)
+                    {
+                        fn(i, j);
+                    }
+                }
+                break;
+            case Kind::kHalfDiallel:
+            case Kind::kFullDiallel:
+                for (size_t i = 0; i < first_.size(); ++i)
+                {
+                    size_t j = kind_ == Kind::kHalfDiallel ? i + 1 : 0;
+                    for (; j < second_.size(); ++j)
+                    {
+                        if (j != i)
+                        {
+                            fn(i, j);
+                        }
+                    }
+                }
+                break;
+        }
+    }
+
+   private:
+    enum class Kind
+    {
+        kPairs,
+        kFactorial,
+        kHalfDiallel,
+        kFullDiallel,
+    };
+
+    CrossDesign(
+        Kind kind,
+        std::vector<std::string> first,
+        std::vector<std::string> second);
+
+    Kind kind_;
+    std::vector<std::string> first_;
+    std::vector<std::string> second_;
+    std::vector<int> first_samples_;
+    std::vector<int> second_samples_;
+};
+
+// Per-cross call and het counts over the sites combine writes, gathered
+// from the output buffer while it is still in cache instead of from a
+// second decode of the output VCF. An inbred-parent cross is het exactly
+// where its parents carry different alleles, so n_het doubles as the
+// count of sites polymorphic between the two parents.
+class CrossSummary
+{
+   public:
+    explicit CrossSummary(size_t n_crosses);
+
+    // `cross_gts` holds two calls per cross in design order.
+    void add(const int32_t* cross_gts);
+    void write(const std::string& path, const CrossDesign& design) const;
+
+   private:
+    size_t n_sites_ = 0;
+    std::vector<size_t> called_;
+    std::vector<size_t> het_;
+};
+
+}  // namespace detail
@@ -0,0 +1,156 @@
+#include "distance.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "kernels.h"
+#include "matrix.h"
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace
+{
+// 4096 sites per block keeps one sample row at 1 KiB, so a 64-sample tile
+// of rows (64 KiB) stays in L2 while its partner row sits in L1.
+constexpr size_t kBlockSites = 4096;
+constexpr size_t kTile = detail::kPanelWidth;
+
+void accumulate_tile(
+    const detail::SampleBlock& block,
+    size_t tile_i,
+    size_t tile_j,
+    detail::IbsKernel kernel,
+    detail::IbsCounts* acc)
+{
+    size_t n = block.n_samples();
+    size_t words = block.used_words();
+    size_t i_end = std::min((tile_i + 1) * kTile, n);
+    size_t j_end = std::min((tile_j + 1) * kTile, n);
+    for (size_t i = tile_i * kTile; i < i_end; ++i)
+    {
+        size_t j_begin = tile_i == tile_j ? i + 1 : tile_j * kTile;
+        detail::IbsCounts* row = acc + (i - tile_i * kTile) * kTile;
+        for (size_t j = j_begin; j < j_end; ++j)
+        {
+            kernel(
+                block.lo(i),
+                block.hi(i),
+                block.lo(j),
+                block.hi(j),
+                words,
+                row[j - tile_j * kTile]);
+        }
+    }
+}
+
+}  // namespace
+
+namespace vcfbox
+{
+void distance_matrix(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    const std::string& metric,
+    bool binary,
+    size_t n_threads)
+{
+    if (metric != "ibs" && metric != "ibs0")
+    {
+        throw std::runtime_error("Unsupported distance metric: " + metric);
+    }
+
+    detail::RegionReader reader(vcf_path);
+    reader.seek(detail::Region{});
+    size_t n_samples = bcf_hdr_nsamples(reader.header());
+    if (n_samples < 2)
+    {
+        throw std::runtime_error(
+            "Distance needs at least two samples: " + vcf_path);
+    }
+
+    detail::TilePairs tiles(n_samples, kTile);
+    // pair counts are the only state that grows with the sample count,
+    // genotypes are held for two blocks at a time
+    std::vector<detail::IbsCounts> acc(tiles.pairs.size() * kTile * kTile);
+    detail::IbsKernel kernel = detail::ibs_kernel();
+
+    detail::SampleBlock first(n_samples, kBlockSites);
+    detail::SampleBlock second(n_samples, kBlockSites);
+    BcfRec rec(bcf_init());
+    Genotypes gt;
+    size_t processd_snp = 0;
+    auto counter = detail::create_counter("Computing distances", processd_snp);
+    counter->show();
+    detail::pipeline_blocks(
+        first,
+        second,
+        [&](detail::SampleBlock& block)
+        {
+            block.reset();
+            while (!block.full())
+            {
+                int n_gt = detail::next_biallelic_gt(reader, rec.get(), gt);
+                if (n_gt == 0)
+                {
+                    break;
+                }
+                block.add_site(gt.p_, n_gt);
+                processd_snp++;
+            }
+            return block.n_sites() > 0;
+        },
+        [&](const detail::SampleBlock& block)
+        {
+            detail::parallel_for(
+                tiles.pairs.size(),
+                n_threads,
+                [&](size_t p)
+                {
+                    accumulate_tile(
+                        block,
+                        tiles.pairs[p].first,
+                        tiles.pairs[p].second,
+                        kernel,
+                        acc.data() + (p * kTile * kTile));
+                });
+        });
+    counter->done();
+
+    auto value = [&](size_t i, size_t j)
+    {
+        if (i == j)
+        {
+            return 0.;
+        }
+        auto [a, b] = std::minmax(i, j);
+        size_t p = tiles.index(a / kTile, b / kTile);
+        const auto& c
+            = acc[(p * kTile * kTile) + ((a % kTile) * kTile) + (b % kTile)];
+        if (c.valid == 0)
+        {
+            return std::numeric_limits<double>::quiet_NaN();
+        }
+        double valid = c.valid;
+        if (metric == "ibs0")
+        {
+            return c.ibs0 / valid;
+        }
+        return (valid - c.ibs2 + c.ibs0) / (2 * valid);
+    };
+    detail::write_square_matrix(
+        out_prefix + (binary ? ".dist.bin" : ".dist"),
+        n_samples,
+        binary,
+        value);
+    detail::write_sample_ids(out_prefix + ".dist.id", reader.header());
+}
+
+}  // namespace vcfbox
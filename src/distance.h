@@ -0,0 +1,19 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+namespace vcfbox
+{
+// Pairwise identity-by-state distance between all samples, over biallelic
+// sites called in both members of a pair. `metric` is "ibs" for
+// 1 - (IBS2 + IBS1 / 2) / n or "ibs0" for the opposite-homozygote fraction.
+// Writes `<out_prefix>.dist` (text) or `<out_prefix>.dist.bin` (row-major
+// float32) and the sample order to `<out_prefix>.dist.id`.
+void distance_matrix(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    const std::string& metric,
+    bool binary,
+    size_t n_threads);
+
+}  // namespace vcfbox
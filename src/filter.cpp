@@ -0,0 +1,168 @@
+#include "filter.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace detail
+{
+bool FilterOptions::filters_samples() const
+{
+    return max_sample_missing < 1. || max_sample_het < 1.;
+}
+
+SiteFilter::SiteFilter(const FilterOptions& options, int n_samples)
+    : n_samples_(n_samples),
+      min_maf_(options.min_maf),
+      max_missing_count_(options.max_missing * n_samples),
+      max_het_(options.max_het),
+      lo_(words_for(n_samples)),
+      hi_(words_for(n_samples))
+{
+    checks_ |= options.min_maf > 0. ? kMaf : 0U;
+    checks_ |= options.max_missing < 1. ? kMissing : 0U;
+    checks_ |= options.max_het < 1. ? kHet : 0U;
+}
+
+bool SiteFilter::pass(const int32_t* gt_arr, int n_gt)
+{
+    if (checks_ == 0)
+    {
+        return true;
+    }
+    pack_site(gt_arr, n_gt, n_samples_, lo_.data(), hi_.data());
+    size_t het = 0;
+    size_t hom_alt = 0;
+    size_t missing = 0;
+    for (size_t w = 0; w < lo_.size(); ++w)
+    {
+        het += std::popcount(lo_[w] & ~hi_[w]);
+        hom_alt += std::popcount(hi_[w] & ~lo_[w]);
+        missing += std::popcount(lo_[w] & hi_[w]);
+    }
+    auto called = static_cast<double>(n_samples_ - missing);
+
+    if ((checks_ & kMissing) != 0
+        && static_cast<double>(missing) > max_missing_count_)
+    {
+        return false;
+    }
+    if ((checks_ & kHet) != 0 && static_cast<double>(het) > max_het_ * called)
+    {
+        return false;
+    }
+    if ((checks_ & kMaf) != 0)
+    {
+        auto alt = static_cast<double>(het + 2 * hom_alt);
+        double minor = std::min(alt, (2 * called) - alt);
+        // also drops sites with no calls, whose MAF is undefined
+        if (called == 0 || minor < min_maf_ * 2 * called)
+        {
+            return false;
+        }
+    }
+    return true;
+}
+
+std::vector<std::string> failing_samples(
+    const std::string& vcf_path,
+    const FilterOptions& options)
+{
+    HtsFile vcf_file(bcf_open(vcf_path.c_str(), "r"));
+    if (!vcf_file)
+    {
+        throw std::runtime_error("Could not open VCF file: " + vcf_path);
+    }
+    BcfHdr header(bcf_hdr_read(vcf_file.get()));
+    if (!header)
+    {
+        throw std::runtime_error("Could not read VCF header from: " + vcf_path);
+    }
+    int n_samples = bcf_hdr_nsamples(header.get());
+    size_t n_words = words_for(n_samples);
+    SampleCounter missing(n_samples);
+    SampleCounter het(n_samples);
+    std::vector<uint64_t> lo(n_words);
+    std::vector<uint64_t> hi(n_words);
+    std::vector<uint64_t> bits(n_words);
+    size_t n_sites = 0;
+
+    BcfRec rec(bcf_init());
+    Genotypes gt;
+    size_t processd_snp = 0;
+    auto counter = create_counter("Computing sample filters", processd_snp);
+    counter->show();
+    while (bcf_read(vcf_file.get(), header.get(), rec.get()) == 0)
+    {
+        processd_snp++;
+        bcf_unpack(rec.get(), BCF_UN_STR);
+        if (rec->n_allele > 2)
+        {
+            continue;
+        }
+        int n_gt = bcf_get_genotypes(header.get(), rec.get(), &gt.p_, &gt.n_);
+        if (n_gt <= 0)
+        {
+            continue;
+        }
+        pack_site(gt.p_, n_gt, n_samples, lo.data(), hi.data());
+        for (size_t w = 0; w < n_words; ++w)
+        {
+            bits[w] = lo[w] & hi[w];
+        }
+        missing.add(bits.data());
+        for (size_t w = 0; w < n_words; ++w)
+        {
+            bits[w] = lo[w] & ~hi[w];
+        }
+        het.add(bits.data());
+        n_sites++;
+    }
+    counter->done();
+
+    std::vector<std::string> failing;
+    const auto& n_missing = missing.totals();
+    const auto& n_het = het.totals();
+    for (int i = 0; i < n_samples; ++i)
+    {
+        auto sites = static_cast<double>(n_sites);
+        auto called = static_cast<double>(n_sites - n_missing[i]);
+        if (static_cast<double>(n_missing[i])
+                > options.max_sample_missing * sites
+            || static_cast<double>(n_het[i]) > options.max_sample_het * called)
+        {
+            failing.emplace_back(header->samples[i]);
+        }
+    }
+    return failing;
+}
+
+void exclude_samples(
+    bcf_hdr_t* header,
+    const std::vector<std::string>& samples)
+{
+    if (samples.empty())
+    {
+        return;
+    }
+    std::string list = "^";
+    for (const auto& sample : samples)
+    {
+        list += sample + ",";
+    }
+    list.pop_back();
+    if (bcf_hdr_set_samples(header, list.c_str(), 0) != 0)
+    {
+        throw std::runtime_error("Failed to exclude samples: " + list);
+    }
+}
+
+}  // namespace detail
@@ -0,0 +1,69 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+// Site and sample QC thresholds shared by the streaming subcommands. Every
+// field defaults to the value that lets everything through. Rates follow
+// `stats`: missing over all samples (or sites), het over called genotypes.
+struct FilterOptions
+{
+    double min_maf = 0.;
+    double max_missing = 1.;
+    double max_het = 1.;
+    double max_sample_missing = 1.;
+    double max_sample_het = 1.;
+
+    bool filters_samples() const;
+};
+
+// The site thresholds turned into a check on the GT array a subcommand has
+// already decoded. Only the enabled tests are run, on a 2-bit packed copy
+// of the site, so the cost is one packing loop and a few popcounts.
+class SiteFilter
+{
+   public:
+    SiteFilter(const FilterOptions& options, int n_samples);
+
+    bool active() const { return checks_ != 0; }
+    bool pass(const int32_t* gt_arr, int n_gt);
+
+   private:
+    enum Check : unsigned
+    {
+        kMaf = 1U << 0,
+        kMissing = 1U << 1,
+        kHet = 1U << 2,
+    };
+
+    unsigned checks_ = 0;
+    int n_samples_;
+    double min_maf_;
+    double max_missing_count_;
+    double max_het_;
+    std::vector<uint64_t> lo_;
+    std::vector<uint64_t> hi_;
+};
+
+// Names of the samples over the sample thresholds, from one counting pass
+// over the biallelic sites of `vcf_path`. Sample filters need the whole
+// file before the first record can be written, so this is the one extra
+// pass they cost.
+std::vector<std::string> failing_samples(
+    const std::string& vcf_path,
+    const FilterOptions& options);
+
+// Restricts `header` to the samples not in `samples`, so records read with
+// it decode only the remaining genotypes.
+void exclude_samples(
+    bcf_hdr_t* header,
+    const std::vector<std::string>& samples);
+
+}  // namespace detail
@@ -0,0 +1,336 @@
+#include "grm.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "kernels.h"
+#include "matrix.h"
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace
+{
+// 256 sites x 64 samples x 4 bytes = 64 KiB per panel, a pair of panels
+// fits in L2 while the float partial sums stay exact enough to be folded
+// into the double accumulator once per block.
+constexpr size_t kBlockSites = 256;
+constexpr size_t kTile = detail::kPanelWidth;
+
+// Streams every polymorphic biallelic site through center(gt, n_gt, z),
+// which fills `n_columns` centred values and returns the site's variance
+// (<= 0 to skip it), into `gram`. Returns the summed variance, VanRaden's
+// scale.
+template <typename CenterFn>
+double accumulate_gram(
+    detail::RegionReader& reader,
+    detail::GramAccumulator& gram,
+    size_t n_columns,
+    size_t n_threads,
+    const std::string& message,
+    CenterFn&& center)
+{
+    detail::DosagePanels first(n_columns, kBlockSites);
+    detail::DosagePanels second(n_columns, kBlockSites);
+    std::vector<float> z(n_columns);
+    double scale = 0;
+    BcfRec rec(bcf_init());
+    Genotypes gt;
+    size_t processd_snp = 0;
+
+    auto counter = detail::create_counter(message, processd_snp);
+    counter->show();
+    detail::pipeline_blocks(
+        first,
+        second,
+        [&](detail::DosagePanels& block)
+        {
+            block.reset();
+            while (!block.full())
+            {
+                int n_gt = detail::next_biallelic_gt(reader, rec.get(), gt);
+                if (n_gt == 0)
+                {
+                    break;
+                }
+                processd_snp++;
+                double var = center(gt.p_, n_gt, z.data());
+                if (var <= 0)
+                {
+                    continue;
+                }
+                scale += var;
+                block.add_site(z.data());
+            }
+            return block.n_sites() > 0;
+        },
+        [&](const detail::DosagePanels& block)
+        { gram.add_block(block, n_threads); });
+    counter->done();
+    return scale;
+}
+
+}  // namespace
+
+namespace vcfbox
+{
+void grm(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    size_t n_threads)
+{
+    detail::RegionReader reader(vcf_path);
+    reader.seek(detail::Region{});
+    size_t n_samples = bcf_hdr_nsamples(reader.header());
+    if (n_samples == 0)
+    {
+        throw std::runtime_error("VCF file has no samples: " + vcf_path);
+    }
+
+    detail::GramAccumulator gram(n_samples);
+    double scale = accumulate_gram(
+        reader,
+        gram,
+        n_samples,
+        n_threads,
+        "Computing GRM",
+        [&](const int32_t* gt_arr, int n_gt, float* z)
+        { return detail::center_dosages(gt_arr, n_gt, n_samples, z); });
+    if (scale == 0)
+    {
+        throw std::runtime_error(
+            "No polymorphic biallelic sites in: " + vcf_path);
+    }
+    detail::write_square_matrix(
+        out_prefix + ".grm.bin",
+        n_samples,
+        true,
+        [&](size_t i, size_t j) { return gram.at(i, j) / scale; });
+    detail::write_sample_ids(out_prefix + ".grm.id", reader.header());
+}
+
+void hybrid_grm(
+    const std::string& vcf_path,
+    const std::vector<detail::SamplePair>& pairs,
+    const std::string& out_prefix,
+    size_t n_threads)
+{
+    if (pairs.empty())
+    {
+        throw std::runtime_error("No hybrids in sample pairs file");
+    }
+    detail::check_sample_consistence(vcf_path, pairs);
+    detail::RegionReader reader(vcf_path);
+    reader.seek(detail::Region{});
+    size_t n_samples = bcf_hdr_nsamples(reader.header());
+    auto design = detail::make_hybrid_design(reader.header(), pairs);
+    size_t n_parents = design.parent_samples.size();
+
+    detail::GramAccumulator gram(n_parents);
+    double scale = accumulate_gram(
+        reader,
+        gram,
+        n_parents,
+        n_threads,
+        "Computing parental GRM",
+        [&](const int32_t* gt_arr, int n_gt, float* c)
+        {
+            return detail::center_gametes(
+                gt_arr, n_gt, n_samples, design, c);
+        });
+
+    if (scale == 0)
+    {
+        throw std::runtime_error(
+            "No polymorphic biallelic sites in: " + vcf_path);
+    }
+    const auto& hybrids = design.hybrids;
+    detail::write_square_matrix(
+        out_prefix + ".grm.bin",
+        hybrids.size(),
+        true,
+        [&](size_t i, size_t j)
+        {
+            auto [a, b] = hybrids[i];
+            auto [c, d] = hybrids[j];
+            return (gram.at(a, c) + gram.at(a, d) + gram.at(b, c)
+                    + gram.at(b, d))
+                   / scale;
+        });
+    std::vector<std::string> names;
+    names.reserve(pairs.size());
+    for (const auto& pair : pairs)
+    {
+        names.push_back(pair.first + "~" + pair.second);
+    }
+    detail::write_sample_ids(out_prefix + ".grm.id", names);
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+DosagePanels::DosagePanels(size_t n_samples, size_t block_sites)
+    : n_samples_(n_samples),
+      block_sites_(block_sites),
+      data_(
+          ((n_samples + kPanelWidth - 1) / kPanelWidth) * block_sites
+          * kPanelWidth)
+{
+}
+
+void DosagePanels::add_site(const float* values)
+{
+    for (size_t i = 0; i < n_samples_; ++i)
+    {
+        size_t tile = i / kPanelWidth;
+        data_[(tile * block_sites_ * kPanelWidth) + (n_sites_ * kPanelWidth)
+              + (i % kPanelWidth)]
+            = values[i];
+    }
+    n_sites_++;
+}
+
+double center_dosages(
+    const int32_t* gt_arr,
+    int n_gt,
+    size_t n_samples,
+    float* z)
+{
+    int ploidy = n_gt / static_cast<int>(n_samples);
+    size_t called = 0;
+    size_t alt = 0;
+    for (size_t i = 0; i < n_samples; ++i)
+    {
+        const int32_t* sample = gt_arr + i * ploidy;
+        GenotypeCode code = encode_gt(
+            sample[0], ploidy > 1 ? sample[1] : bcf_int32_vector_end);
+        // stash the code, z is rewritten below once p is known
+        z[i] = static_cast<float>(code);
+        if (code != kMissing)
+        {
+            called++;
+            alt += code == kHet ? 1 : code == kHomAlt ? 2 : 0;
+        }
+    }
+    if (called == 0)
+    {
+        return -1;
+    }
+    double p = static_cast<double>(alt) / (2. * static_cast<double>(called));
+    auto two_p = static_cast<float>(2 * p);
+    for (size_t i = 0; i < n_samples; ++i)
+    {
+        auto code = static_cast<GenotypeCode>(z[i]);
+        float dosage = code == kHet ? 1.F : code == kHomAlt ? 2.F : 0.F;
+        z[i] = code == kMissing ? 0.F : dosage - two_p;
+    }
+    return 2 * p * (1 - p);
+}
+
+HybridDesign make_hybrid_design(
+    bcf_hdr_t* header,
+    const std::vector<SamplePair>& pairs)
+{
+    HybridDesign design;
+    std::unordered_map<std::string, size_t> slot;
+    auto parent_slot = [&](const std::string& name)
+    {
+        auto [it, inserted] = slot.try_emplace(name, slot.size());
+        if (inserted)
+        {
+            design.parent_samples.push_back(
+                bcf_hdr_id2int(header, BCF_DT_SAMPLE, name.c_str()));
+            design.weights.push_back(0.);
+        }
+        design.weights[it->second] += 1.;
+        return it->second;
+    };
+    design.hybrids.reserve(pairs.size());
+    for (const auto& [female, male] : pairs)
+    {
+        size_t a = parent_slot(female);
+        size_t b = parent_slot(male);
+        design.hybrids.emplace_back(a, b);
+    }
+    return design;
+}
+
+double center_gametes(
+    const int32_t* gt_arr,
+    int n_gt,
+    size_t n_samples,
+    const HybridDesign& design,
+    float* c)
+{
+    int ploidy = n_gt / static_cast<int>(n_samples);
+    size_t n_parents = design.parent_samples.size();
+    double called = 0;
+    double alt = 0;
+    for (size_t j = 0; j < n_parents; ++j)
+    {
+        const int32_t* sample = gt_arr + (design.parent_samples[j] * ploidy);
+        GenotypeCode code = encode_gt(
+            sample[0], ploidy > 1 ? sample[1] : bcf_int32_vector_end);
+        // stash the code, c is rewritten below once p is known
+        c[j] = static_cast<float>(code);
+        if (code == kHomRef || code == kHomAlt)
+        {
+            // p is the hybrid allele frequency, so a parent counts once
+            // per hybrid it is a parent of
+            called += design.weights[j];
+            alt += code == kHomAlt ? design.weights[j] : 0.;
+        }
+    }
+    if (called == 0)
+    {
+        return -1;
+    }
+    double p = alt / called;
+    auto p_f = static_cast<float>(p);
+    for (size_t j = 0; j < n_parents; ++j)
+    {
+        auto code = static_cast<GenotypeCode>(c[j]);
+        c[j] = code == kHomAlt ? 1.F - p_f : code == kHomRef ? -p_f : 0.F;
+    }
+    return 2 * p * (1 - p);
+}
+
+GramAccumulator::GramAccumulator(size_t n_samples)
+    : tiles_(n_samples, kTile), acc_(tiles_.pairs.size() * kTile * kTile)
+{
+}
+
+void GramAccumulator::add_block(const DosagePanels& block, size_t n_threads)
+{
+    parallel_for(
+        tiles_.pairs.size(),
+        n_threads,
+        [&](size_t p)
+        {
+            float tile[kTile * kTile];
+            auto [ti, tj] = tiles_.pairs[p];
+            gram_tile_f32(
+                block.panel(ti), block.panel(tj), block.n_sites(), tile);
+            double* acc = acc_.data() + (p * kTile * kTile);
+            for (size_t k = 0; k < kTile * kTile; ++k)
+            {
+                acc[k] += tile[k];
+            }
+        });
+}
+
+double GramAccumulator::at(size_t i, size_t j) const
+{
+    auto [a, b] = std::minmax(i, j);
+    size_t p = tiles_.index(a / kTile, b / kTile);
+    return acc_[(p * kTile * kTile) + ((a % kTile) * kTile) + (b % kTile)];
+}
+
+}  // namespace detail
@@ -0,0 +1,115 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernels.h"
+#include "matrix.h"
+#include "utils.h"
+
+namespace vcfbox
+{
+// VanRaden (2008) genomic relationship matrix, G = Z Z' / (2 sum p(1 - p)),
+// with Z the dosages centred by twice the allele frequency and missing
+// calls imputed to the mean. Writes `<out_prefix>.grm.bin` (row-major
+// float32, n x n) and the sample order to `<out_prefix>.grm.id`.
+void grm(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    size_t n_threads);
+
+// The same matrix among the hybrids of `pairs`, computed from the parents
+// alone. A hybrid's dosage is the sum of its parents' gametes, so with
+// gametes centred by the hybrid allele frequency Z_hyb = P C, where C is
+// parents x sites and P picks two parents per hybrid, and
+// G_hyb = P (C C') P' / scale. Only the parental C C' is accumulated; the
+// hybrid matrix is expanded from it while writing. Het or missing parental
+// calls are imputed to the mean gamete rather than masking the hybrid,
+// which is what keeps the decomposition exact. Writes
+// `<out_prefix>.grm.bin` and the "A~B" hybrid names to `<out_prefix>.grm.id`.
+void hybrid_grm(
+    const std::string& vcf_path,
+    const std::vector<detail::SamplePair>& pairs,
+    const std::string& out_prefix,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// A block of per-site sample values in site-major panels of kPanelWidth
+// samples, zero padded past the last sample, which is what gram_tile_f32
+// consumes.
+class DosagePanels
+{
+   public:
+    DosagePanels(size_t n_samples, size_t block_sites);
+
+    void reset() { n_sites_ = 0; }
+    bool full() const { return n_sites_ == block_sites_; }
+    size_t n_sites() const { return n_sites_; }
+    size_t n_samples() const { return n_samples_; }
+
+    void add_site(const float* values);
+
+    const float* panel(size_t tile) const
+    {
+        return data_.data() + (tile * block_sites_ * kPanelWidth);
+    }
+
+   private:
+    size_t n_samples_;
+    size_t block_sites_;
+    size_t n_sites_ = 0;
+    std::vector<float> data_;
+};
+
+// Centres one site's dosages by 2p into `z` (missing -> 0) and returns
+// 2p(1 - p), or a negative value when no sample is called.
+double center_dosages(
+    const int32_t* gt_arr,
+    int n_gt,
+    size_t n_samples,
+    float* z);
+
+// The parents that appear in a pairs file, in first-use order, and every
+// hybrid as a pair of indices into them. `weights` counts how many hybrids
+// each parent contributes a gamete to.
+struct HybridDesign
+{
+    std::vector<int> parent_samples;
+    std::vector<double> weights;
+    std::vector<std::pair<size_t, size_t>> hybrids;
+};
+
+HybridDesign make_hybrid_design(
+    bcf_hdr_t* header,
+    const std::vector<SamplePair>& pairs);
+
+// Writes each parent's gamete (0/1 for a homozygous call) minus the hybrid
+// allele frequency p into `c` (het or missing -> 0) and returns 2p(1 - p),
+// or a negative value when no parent is called.
+double center_gametes(
+    const int32_t* gt_arr,
+    int n_gt,
+    size_t n_samples,
+    const HybridDesign& design,
+    float* c);
+
+// Running sum of z_i * z_j over all sites for every sample pair, kept in
+// double per tile pair while each block product runs in float32.
+class GramAccumulator
+{
+   public:
+    explicit GramAccumulator(size_t n_samples);
+
+    void add_block(const DosagePanels& block, size_t n_threads);
+    double at(size_t i, size_t j) const;
+
+   private:
+    TilePairs tiles_;
+    std::vector<double> acc_;
+};
+
+}  // namespace detail
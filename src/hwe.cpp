@@ -0,0 +1,99 @@
+#include "hwe.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <numeric>
+#include <utility>
+#include <vector>
+
+namespace detail
+{
+double HweTest::p_value(size_t hom_ref, size_t het, size_t hom_alt)
+{
+    size_t n = hom_ref + het + hom_alt;
+    size_t n_rare = het + (2 * std::min(hom_ref, hom_alt));
+    return table(n, n_rare)[het / 2];
+}
+
+// Entry k belongs to het count (n_rare % 2) + 2k, the only counts with the
+// right parity. Probabilities follow Wigginton's recurrence outwards from
+// the most likely het count, then each entry becomes the summed probability
+// of all outcomes no more likely than it.
+const std::vector<double>& HweTest::table(size_t n, size_t n_rare)
+{
+    uint64_t key = (static_cast<uint64_t>(n) << 32) | n_rare;
+    auto it = tables_.find(key);
+    if (it != tables_.end())
+    {
+        return it->second;
+    }
+
+    size_t n_entries = (n_rare / 2) + 1;
+    if (cached_ + n_entries > kMaxCached)
+    {
+        tables_.clear();
+        cached_ = 0;
+    }
+    std::vector<double> probs(n_entries, 0.);
+    if (n > 0)
+    {
+        size_t mid = n_rare * ((2 * n) - n_rare) / (2 * n);
+        if ((mid % 2) != (n_rare % 2))
+        {
+            mid++;
+        }
+        probs[mid / 2] = 1.;
+
+        double hom_rare = static_cast<double>((n_rare - mid) / 2);
+        double hom_common = static_cast<double>(n - mid) - hom_rare;
+        for (size_t h = mid; h > 1; h -= 2)
+        {
+            auto hets = static_cast<double>(h);
+            probs[(h - 2) / 2] = probs[h / 2] * hets * (hets - 1)
+                                 / (4 * (hom_rare + 1) * (hom_common + 1));
+            hom_rare++;
+            hom_common++;
+        }
+
+        hom_rare = static_cast<double>((n_rare - mid) / 2);
+        hom_common = static_cast<double>(n - mid) - hom_rare;
+        for (size_t h = mid; h + 2 <= n_rare; h += 2)
+        {
+            auto hets = static_cast<double>(h);
+            probs[(h + 2) / 2] = probs[h / 2] * 4 * hom_rare * hom_common
+                                 / ((hets + 2) * (hets + 1));
+            hom_rare--;
+            hom_common--;
+        }
+    }
+    double sum = std::accumulate(probs.begin(), probs.end(), 0.);
+
+    std::vector<size_t> order(n_entries);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(
+        order.begin(),
+        order.end(),
+        [&](size_t a, size_t b) { return probs[a] < probs[b]; });
+    std::vector<double> p_values(n_entries, 1.);
+    double tail = 0;
+    for (size_t k = 0; k < n_entries;)
+    {
+        // equally likely outcomes are all part of each other's tail
+        size_t end = k;
+        while (end < n_entries && probs[order[end]] == probs[order[k]])
+        {
+            tail += probs[order[end]];
+            end++;
+        }
+        for (; k < end; ++k)
+        {
+            p_values[order[k]] = sum > 0 ? std::min(1., tail / sum) : 1.;
+        }
+    }
+
+    cached_ += n_entries;
+    return tables_.emplace(key, std::move(p_values)).first->second;
+}
+
+}  // namespace detail
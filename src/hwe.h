@@ -0,0 +1,30 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <unordered_map>
+#include <vector>
+
+namespace detail
+{
+// Exact test of Hardy-Weinberg equilibrium for a biallelic site (Wigginton,
+// Cutler and Abecasis 2005). The null distribution of the het count only
+// depends on the number of called samples and rare alleles, so the p-value
+// of every het count is tabulated once per (called, rare) configuration and
+// later sites with that configuration are a lookup. Not thread safe, keep
+// one per worker.
+class HweTest
+{
+   public:
+    double p_value(size_t hom_ref, size_t het, size_t hom_alt);
+
+    // doubles kept across all tables before the cache starts over
+    static constexpr size_t kMaxCached = size_t{1} << 22;
+
+   private:
+    const std::vector<double>& table(size_t n, size_t n_rare);
+
+    std::unordered_map<uint64_t, std::vector<double>> tables_;
+    size_t cached_ = 0;
+};
+
+}  // namespace detail
@@ -0,0 +1,158 @@
+#include "impute.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "packed.h"
+
+namespace detail
+{
+KnnImputer::KnnImputer(
+    size_t n_samples,
+    std::vector<int> targets,
+    const ImputeOptions& options)
+    : n_samples_(n_samples),
+      targets_(std::move(targets)),
+      options_(options),
+      ld_(n_samples, kSlots),
+      lo_(n_samples, ~uint64_t{0}),
+      hi_(n_samples, ~uint64_t{0})
+{
+}
+
+void KnnImputer::add_site(size_t ordinal, const int32_t* gt_arr, int n_gt)
+{
+    ld_.set_site(ordinal, gt_arr, n_gt);
+    uint64_t bit = uint64_t{1} << (ordinal % kSlots);
+    int ploidy = n_gt / static_cast<int>(n_samples_);
+    for (size_t i = 0; i < n_samples_; ++i)
+    {
+        const int32_t* sample = gt_arr + (i * ploidy);
+        GenotypeCode code = encode_gt(
+            sample[0], ploidy > 1 ? sample[1] : bcf_int32_vector_end);
+        lo_[i] = (lo_[i] & ~bit) | ((code & 1) != 0 ? bit : 0);
+        hi_[i] = (hi_[i] & ~bit) | ((code & 2) != 0 ? bit : 0);
+    }
+}
+
+size_t KnnImputer::impute(
+    size_t centre,
+    size_t first,
+    size_t last,
+    int32_t* gt_arr,
+    int n_gt)
+{
+    if (n_gt != 2 * static_cast<int>(n_samples_))
+    {
+        return 0;
+    }
+    uint64_t centre_bit = uint64_t{1} << (centre % kSlots);
+    auto missing_at_centre = [&](size_t i)
+    { return (lo_[i] & hi_[i] & centre_bit) != 0; };
+    // het and missing calls both set the lo bit
+    auto hom_at_centre = [&](size_t i) { return (lo_[i] & centre_bit) == 0; };
+    if (std::none_of(
+            targets_.begin(),
+            targets_.end(),
+            [&](int t) { return missing_at_centre(t); }))
+    {
+        return 0;
+    }
+
+    // the flanking sites in highest LD with the centre, as a slot mask
+    ranked_.clear();
+    for (size_t s = first; s <= last; ++s)
+    {
+        if (s != centre)
+        {
+            ranked_.emplace_back(ld_.r2(centre, s), s);
+        }
+    }
+    size_t n_ld = std::min(options_.ld_sites, ranked_.size());
+    std::partial_sort(
+        ranked_.begin(),
+        ranked_.begin() + static_cast<ptrdiff_t>(n_ld),
+        ranked_.end(),
+        [](const auto& a, const auto& b) { return a.first > b.first; });
+    uint64_t mask = 0;
+    for (size_t s = 0; s < n_ld; ++s)
+    {
+        mask |= uint64_t{1} << (ranked_[s].second % kSlots);
+    }
+
+    auto nearer = [](const auto& a, const auto& b)
+    {
+        return a.first > b.first
+               || (a.first == b.first && a.second < b.second);
+    };
+    size_t filled = 0;
+    for (int t : targets_)
+    {
+        if (!missing_at_centre(t))
+        {
+            continue;
+        }
+        uint64_t het_t = lo_[t] & ~hi_[t];
+        uint64_t alt_t = hi_[t] & ~lo_[t];
+        uint64_t ref_t = ~lo_[t] & ~hi_[t];
+        uint64_t called_t = ~(lo_[t] & hi_[t]) & mask;
+        neighbours_.clear();
+        for (size_t j = 0; j < n_samples_; ++j)
+        {
+            if (static_cast<int>(j) == t || !hom_at_centre(j))
+            {
+                continue;
+            }
+            uint64_t both = called_t & ~(lo_[j] & hi_[j]);
+            if (both == 0)
+            {
+                continue;
+            }
+            uint64_t het_j = lo_[j] & ~hi_[j];
+            uint64_t alt_j = hi_[j] & ~lo_[j];
+            uint64_t ref_j = ~lo_[j] & ~hi_[j];
+            // a het against a homozygote is one allele apart, opposite
+            // homozygotes two
+            int dist = std::popcount((het_t ^ het_j) & both)
+                       + (2
+                          * std::popcount(
+                              ((ref_t & alt_j) | (alt_t & ref_j)) & both));
+            double similarity = 1.
+                                - (static_cast<double>(dist)
+                                   / (2. * std::popcount(both)));
+            neighbours_.emplace_back(similarity, static_cast<int>(j));
+        }
+        if (neighbours_.empty())
+        {
+            continue;
+        }
+
+        size_t k = std::min(options_.k, neighbours_.size());
+        std::partial_sort(
+            neighbours_.begin(),
+            neighbours_.begin() + static_cast<ptrdiff_t>(k),
+            neighbours_.end(),
+            nearer);
+        // every voter is homozygous, so the vote is between the alleles
+        auto allele_of = [&](int j)
+        { return (hi_[j] & centre_bit) != 0 ? 1 : 0; };
+        double votes[2] = {};
+        for (size_t n = 0; n < k; ++n)
+        {
+            votes[allele_of(neighbours_[n].second)] += neighbours_[n].first;
+        }
+        // the nearest neighbour wins ties, all-zero votes included
+        int best = allele_of(neighbours_[0].second);
+        best = votes[1 - best] > votes[best] ? 1 - best : best;
+        gt_arr[2 * t] = bcf_gt_unphased(best);
+        gt_arr[(2 * t) + 1] = bcf_gt_unphased(best);
+        filled++;
+    }
+    return filled;
+}
+
+}  // namespace detail
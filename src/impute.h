@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "ldprune.h"
+
+namespace detail
+{
+struct ImputeOptions
+{
+    bool enabled = false;
+    size_t ld_sites = 20;  // flanking sites the distance is taken over
+    size_t k = 5;          // neighbours voting on a missing call
+};
+
+// LD-kNN imputation (Money et al. 2015) over a sliding window of one
+// contig: a missing call is filled by a similarity-weighted vote of the k
+// samples nearest to it over the flanking sites in highest LD with the
+// site being imputed. The targets are inbred parents, whose het calls
+// concat_gt would only turn missing again, so only samples homozygous at
+// the site vote and a fill is always 0/0 or 1/1.
+//
+// Sites sit in a 64-slot ring, site ordinal k in slot k % 64, both as
+// LdWindow planes for r^2 and transposed to one word per sample and
+// plane, so the distance between two samples over any subset of the
+// window is a couple of ANDs and popcounts against a slot mask.
+class KnnImputer
+{
+   public:
+    // Sites on each side of the one being imputed; with it, 63 of the 64
+    // slots.
+    static constexpr size_t kFlank = 31;
+
+    // Only the calls of `targets` are filled, every sample may vote.
+    KnnImputer(
+        size_t n_samples,
+        std::vector<int> targets,
+        const ImputeOptions& options);
+
+    void add_site(size_t ordinal, const int32_t* gt_arr, int n_gt);
+
+    // Fills the missing target calls of diploid `gt_arr`, the calls of
+    // site `centre`, from sites `first`..`last` (inclusive, all added and
+    // within kFlank of `centre`). Returns the number of calls filled.
+    size_t impute(
+        size_t centre,
+        size_t first,
+        size_t last,
+        int32_t* gt_arr,
+        int n_gt);
+
+   private:
+    static constexpr size_t kSlots = 64;
+
+    size_t n_samples_;
+    std::vector<int> targets_;
+    ImputeOptions options_;
+    LdWindow ld_;
+    // one bit per slot, per sample
+    std::vector<uint64_t> lo_;
+    std::vector<uint64_t> hi_;
+    std::vector<std::pair<double, size_t>> ranked_;
+    std::vector<std::pair<double, int>> neighbours_;
+};
+
+}  // namespace detail
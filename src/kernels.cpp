@@ -0,0 +1,589 @@
+#include "kernels.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define VCFBOX_X86 1
+// Plain loops the compiler vectorises, cloned per ISA and picked by the
+// loader, for kernels that need no hand-written intrinsics. Each clone is
+// named by a whole -march level, a comma inside one string would make GCC
+// emit one clone per feature instead.
+#define VCFBOX_CLONES                                  \
+    __attribute__((target_clones(                      \
+        "arch=x86-64-v4", "arch=x86-64-v3", "default")))
+#else
+#define VCFBOX_CLONES
+#endif
+
+namespace detail
+{
+namespace
+{
+// Per word: valid = both called, ibs0 = both hom (lo clear) with differing
+// hi, ibs2 = identical code and valid.
+inline void ibs_word(
+    uint64_t la,
+    uint64_t ha,
+    uint64_t lb,
+    uint64_t hb,
+    IbsCounts& counts)
+{
+    uint64_t valid = ~((la & ha) | (lb & hb));
+    uint64_t ibs0 = ~(la | lb) & (ha ^ hb);
+    uint64_t ibs2 = valid & ~((la ^ lb) | (ha ^ hb));
+    counts.valid += std::popcount(valid);
+    counts.ibs0 += std::popcount(ibs0);
+    counts.ibs2 += std::popcount(ibs2);
+}
+
+#ifdef VCFBOX_X86
+// Nibble lookup popcount (Mula et al.), AVX2 has no vector popcount.
+__attribute__((target("avx2"))) inline __m256i popcount256(__m256i v)
+{
+    const __m256i lookup = _mm256_setr_epi8(
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+        0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i low_mask = _mm256_set1_epi8(0x0f);
+    __m256i lo = _mm256_and_si256(v, low_mask);
+    __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low_mask);
+    __m256i bytes = _mm256_add_epi8(
+        _mm256_shuffle_epi8(lookup, lo), _mm256_shuffle_epi8(lookup, hi));
+    return _mm256_sad_epu8(bytes, _mm256_setzero_si256());
+}
+
+__attribute__((target("avx2"))) inline __m256i load256(const uint64_t* p)
+{
+    return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+}
+
+__attribute__((target("avx2"))) inline uint64_t hsum256(__m256i v)
+{
+    return static_cast<uint64_t>(_mm256_extract_epi64(v, 0))
+           + static_cast<uint64_t>(_mm256_extract_epi64(v, 1))
+           + static_cast<uint64_t>(_mm256_extract_epi64(v, 2))
+           + static_cast<uint64_t>(_mm256_extract_epi64(v, 3));
+}
+
+__attribute__((target("avx512f"))) inline uint64_t hsum512(__m512i v)
+{
+    alignas(64) uint64_t lanes[8];
+    _mm512_store_si512(lanes, v);
+    uint64_t sum = 0;
+    for (uint64_t lane : lanes)
+    {
+        sum += lane;
+    }
+    return sum;
+}
+#endif
+
+// The word loops of ld_counts and trio_counts, forced inline into each ISA
+// build so the compiler vectorises the popcounts for that target.
+__attribute__((always_inline)) inline LdCounts ld_words(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    const uint64_t* het_a = a;
+    const uint64_t* hom_a = a + n_words;
+    const uint64_t* call_a = a + (2 * n_words);
+    const uint64_t* het_b = b;
+    const uint64_t* hom_b = b + n_words;
+    const uint64_t* call_b = b + (2 * n_words);
+    LdCounts c;
+    for (size_t w = 0; w < n_words; ++w)
+    {
+        c.n += std::popcount(call_a[w] & call_b[w]);
+        c.het_a += std::popcount(het_a[w] & call_b[w]);
+        c.hom_a += std::popcount(hom_a[w] & call_b[w]);
+        c.het_b += std::popcount(het_b[w] & call_a[w]);
+        c.hom_b += std::popcount(hom_b[w] & call_a[w]);
+        c.het_het += std::popcount(het_a[w] & het_b[w]);
+        c.het_hom += std::popcount(het_a[w] & hom_b[w]);
+        c.hom_het += std::popcount(hom_a[w] & het_b[w]);
+        c.hom_hom += std::popcount(hom_a[w] & hom_b[w]);
+    }
+    return c;
+}
+
+__attribute__((always_inline)) inline TrioCounts trio_words(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    TrioCounts c;
+    for (size_t w = 0; w < n_words; ++w)
+    {
+        uint64_t ref_f = ~lo_f[w] & ~hi_f[w];
+        uint64_t alt_f = hi_f[w] & ~lo_f[w];
+        uint64_t ref_m = ~lo_m[w] & ~hi_m[w];
+        uint64_t alt_m = hi_m[w] & ~lo_m[w];
+        // predicted hybrid call in the same lo/hi code
+        uint64_t lo_p = (ref_f & alt_m) | (alt_f & ref_m);
+        uint64_t hi_p = alt_f & alt_m;
+        uint64_t both = (ref_f | alt_f) & (ref_m | alt_m)
+                        & ~(lo_h[w] & hi_h[w]);
+        uint64_t ref_h = ~lo_h[w] & ~hi_h[w];
+        uint64_t alt_h = hi_h[w] & ~lo_h[w];
+        c.compared += std::popcount(both);
+        c.discordant += std::popcount(
+            ((lo_h[w] ^ lo_p) | (hi_h[w] ^ hi_p)) & both);
+        c.opposite += std::popcount(
+            ((ref_f & ref_m & alt_h) | (alt_f & alt_m & ref_h)) & both);
+    }
+    return c;
+}
+
+}  // namespace
+
+void ibs_counts_generic(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts)
+{
+    for (size_t w = 0; w < n_words; ++w)
+    {
+        ibs_word(lo_a[w], hi_a[w], lo_b[w], hi_b[w], counts);
+    }
+}
+
+#ifdef VCFBOX_X86
+__attribute__((target("avx2"))) void ibs_counts_avx2(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts)
+{
+    const __m256i ones = _mm256_set1_epi64x(-1);
+    __m256i acc_valid = _mm256_setzero_si256();
+    __m256i acc_ibs0 = _mm256_setzero_si256();
+    __m256i acc_ibs2 = _mm256_setzero_si256();
+    size_t w = 0;
+    for (; w + 4 <= n_words; w += 4)
+    {
+        __m256i la = load256(lo_a + w);
+        __m256i ha = load256(hi_a + w);
+        __m256i lb = load256(lo_b + w);
+        __m256i hb = load256(hi_b + w);
+        __m256i missing = _mm256_or_si256(
+            _mm256_and_si256(la, ha), _mm256_and_si256(lb, hb));
+        __m256i valid = _mm256_andnot_si256(missing, ones);
+        __m256i ibs0 = _mm256_andnot_si256(
+            _mm256_or_si256(la, lb), _mm256_xor_si256(ha, hb));
+        __m256i diff = _mm256_or_si256(
+            _mm256_xor_si256(la, lb), _mm256_xor_si256(ha, hb));
+        __m256i ibs2 = _mm256_andnot_si256(diff, valid);
+        acc_valid = _mm256_add_epi64(acc_valid, popcount256(valid));
+        acc_ibs0 = _mm256_add_epi64(acc_ibs0, popcount256(ibs0));
+        acc_ibs2 = _mm256_add_epi64(acc_ibs2, popcount256(ibs2));
+    }
+    counts.valid += hsum256(acc_valid);
+    counts.ibs0 += hsum256(acc_ibs0);
+    counts.ibs2 += hsum256(acc_ibs2);
+    for (; w < n_words; ++w)
+    {
+        ibs_word(lo_a[w], hi_a[w], lo_b[w], hi_b[w], counts);
+    }
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq"))) void ibs_counts_avx512(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts)
+{
+    const __m512i ones = _mm512_set1_epi64(-1);
+    __m512i acc_valid = _mm512_setzero_si512();
+    __m512i acc_ibs0 = _mm512_setzero_si512();
+    __m512i acc_ibs2 = _mm512_setzero_si512();
+    size_t w = 0;
+    for (; w + 8 <= n_words; w += 8)
+    {
+        __m512i la = _mm512_loadu_si512(lo_a + w);
+        __m512i ha = _mm512_loadu_si512(hi_a + w);
+        __m512i lb = _mm512_loadu_si512(lo_b + w);
+        __m512i hb = _mm512_loadu_si512(hi_b + w);
+        __m512i missing = _mm512_or_si512(
+            _mm512_and_si512(la, ha), _mm512_and_si512(lb, hb));
+        __m512i valid = _mm512_xor_si512(missing, ones);
+        __m512i ibs0 = _mm512_and_si512(
+            _mm512_xor_si512(_mm512_or_si512(la, lb), ones),
+            _mm512_xor_si512(ha, hb));
+        __m512i diff = _mm512_or_si512(
+            _mm512_xor_si512(la, lb), _mm512_xor_si512(ha, hb));
+        __m512i ibs2 = _mm512_and_si512(_mm512_xor_si512(diff, ones), valid);
+        acc_valid = _mm512_add_epi64(acc_valid, _mm512_popcnt_epi64(valid));
+        acc_ibs0 = _mm512_add_epi64(acc_ibs0, _mm512_popcnt_epi64(ibs0));
+        acc_ibs2 = _mm512_add_epi64(acc_ibs2, _mm512_popcnt_epi64(ibs2));
+    }
+    counts.valid += hsum512(acc_valid);
+    counts.ibs0 += hsum512(acc_ibs0);
+    counts.ibs2 += hsum512(acc_ibs2);
+    for (; w < n_words; ++w)
+    {
+        ibs_word(lo_a[w], hi_a[w], lo_b[w], hi_b[w], counts);
+    }
+}
+
+Isa detect_isa()
+{
+    static const Isa isa = []
+    {
+        if (__builtin_cpu_supports("avx512f")
+            && __builtin_cpu_supports("avx512vpopcntdq"))
+        {
+            return Isa::kAvx512;
+        }
+        if (__builtin_cpu_supports("avx2"))
+        {
+            return Isa::kAvx2;
+        }
+        return Isa::kGeneric;
+    }();
+    return isa;
+}
+#else
+void ibs_counts_avx2(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts)
+{
+    ibs_counts_generic(lo_a, hi_a, lo_b, hi_b, n_words, counts);
+}
+
+void ibs_counts_avx512(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts)
+{
+    ibs_counts_generic(lo_a, hi_a, lo_b, hi_b, n_words, counts);
+}
+
+Isa detect_isa()
+{
+    return Isa::kGeneric;
+}
+#endif
+
+const char* isa_name(Isa isa)
+{
+    switch (isa)
+    {
+        case Isa::kAvx512:
+            return "avx512";
+        case Isa::kAvx2:
+            return "avx2";
+        default:
+            return "generic";
+    }
+}
+
+// Four output rows are kept in registers per sweep over the panels, so b is
+// streamed from cache once per four rows rather than once per row. The
+// innermost loop runs across the panel width with no reduction, which
+// vectorises without reassociating float additions.
+VCFBOX_CLONES void gram_tile_f32(
+    const float* a_panel,
+    const float* b_panel,
+    size_t n_sites,
+    float* out)
+{
+    constexpr size_t kRows = 4;
+    for (size_t i0 = 0; i0 < kPanelWidth; i0 += kRows)
+    {
+        float acc[kRows][kPanelWidth] = {};
+        for (size_t k = 0; k < n_sites; ++k)
+        {
+            const float* a = a_panel + (k * kPanelWidth) + i0;
+            const float* b = b_panel + (k * kPanelWidth);
+            for (size_t r = 0; r < kRows; ++r)
+            {
+                for (size_t j = 0; j < kPanelWidth; ++j)
+                {
+                    acc[r][j] += a[r] * b[j];
+                }
+            }
+        }
+        for (size_t r = 0; r < kRows; ++r)
+        {
+            for (size_t j = 0; j < kPanelWidth; ++j)
+            {
+                out[((i0 + r) * kPanelWidth) + j] = acc[r][j];
+            }
+        }
+    }
+}
+
+// Both loops keep the short `width` dimension innermost, so they vectorise
+// over columns while the panel's rows of q or y stay in L1.
+VCFBOX_CLONES void panel_project(
+    const float* panel,
+    size_t n_sites,
+    const double* q,
+    size_t width,
+    double* t)
+{
+    for (size_t s = 0; s < n_sites; ++s)
+    {
+        const float* z = panel + (s * kPanelWidth);
+        double* ts = t + (s * width);
+        for (size_t i = 0; i < kPanelWidth; ++i)
+        {
+            double zi = z[i];
+            const double* qi = q + (i * width);
+            for (size_t l = 0; l < width; ++l)
+            {
+                ts[l] += zi * qi[l];
+            }
+        }
+    }
+}
+
+VCFBOX_CLONES void panel_accumulate(
+    const float* panel,
+    size_t n_sites,
+    const double* t,
+    size_t width,
+    double* y)
+{
+    for (size_t s = 0; s < n_sites; ++s)
+    {
+        const float* z = panel + (s * kPanelWidth);
+        const double* ts = t + (s * width);
+        for (size_t i = 0; i < kPanelWidth; ++i)
+        {
+            double zi = z[i];
+            double* yi = y + (i * width);
+            for (size_t l = 0; l < width; ++l)
+            {
+                yi[l] += zi * ts[l];
+            }
+        }
+    }
+}
+
+// Written as selects rather than branches so every clone vectorises it.
+VCFBOX_CLONES void viterbi_step(
+    float* score,
+    const uint8_t* obs,
+    const HmmStep& step,
+    uint8_t* back,
+    size_t n)
+{
+    float* ref = score;
+    float* het = score + n;
+    float* donor = score + (2 * n);
+    for (size_t i = 0; i < n; ++i)
+    {
+        float r = ref[i];
+        float h = het[i];
+        float d = donor[i];
+        // each state is entered by staying or from the better other state
+        float from_hd = std::max(h, d) + step.log_switch;
+        float from_rd = std::max(r, d) + step.log_switch;
+        float from_rh = std::max(r, h) + step.log_switch;
+        uint8_t arg_hd = h >= d ? 1 : 2;
+        uint8_t arg_rd = r >= d ? 0 : 2;
+        uint8_t arg_rh = r >= h ? 0 : 1;
+        float stay_r = r + step.log_stay;
+        float stay_h = h + step.log_stay;
+        float stay_d = d + step.log_stay;
+        uint8_t back_r = stay_r >= from_hd ? 0 : arg_hd;
+        uint8_t back_h = stay_h >= from_rd ? 1 : arg_rd;
+        uint8_t back_d = stay_d >= from_rh ? 2 : arg_rh;
+
+        uint8_t o = obs[i];
+        float miss = o == 3 ? 0.F : step.log_mismatch;
+        r = std::max(stay_r, from_hd) + (o == 0 ? step.log_match : miss);
+        h = std::max(stay_h, from_rd) + (o == 1 ? step.log_match : miss);
+        d = std::max(stay_d, from_rh) + (o == 2 ? step.log_match : miss);
+        float best = std::max(r, std::max(h, d));
+        ref[i] = r - best;
+        het[i] = h - best;
+        donor[i] = d - best;
+        back[i] = static_cast<uint8_t>(
+            back_r | (back_h << 2) | (back_d << 4));
+    }
+}
+
+LdCounts ld_counts_generic(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    return ld_words(a, b, n_words);
+}
+
+TrioCounts trio_counts_generic(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    return trio_words(lo_h, hi_h, lo_f, hi_f, lo_m, hi_m, n_words);
+}
+
+#ifdef VCFBOX_X86
+// Popcount reductions only vectorise with AVX512_VPOPCNTDQ; the AVX2 build
+// still gains the wider logic ops and a hardware scalar popcount.
+__attribute__((target("avx2,popcnt"))) LdCounts ld_counts_avx2(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    return ld_words(a, b, n_words);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) LdCounts
+ld_counts_avx512(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    return ld_words(a, b, n_words);
+}
+
+__attribute__((target("avx2,popcnt"))) TrioCounts trio_counts_avx2(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    return trio_words(lo_h, hi_h, lo_f, hi_f, lo_m, hi_m, n_words);
+}
+
+__attribute__((target("avx512f,avx512vpopcntdq,popcnt"))) TrioCounts
+trio_counts_avx512(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    return trio_words(lo_h, hi_h, lo_f, hi_f, lo_m, hi_m, n_words);
+}
+#else
+LdCounts ld_counts_avx2(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    return ld_words(a, b, n_words);
+}
+
+LdCounts ld_counts_avx512(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    return ld_words(a, b, n_words);
+}
+
+TrioCounts trio_counts_avx2(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    return trio_words(lo_h, hi_h, lo_f, hi_f, lo_m, hi_m, n_words);
+}
+
+TrioCounts trio_counts_avx512(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    return trio_words(lo_h, hi_h, lo_f, hi_f, lo_m, hi_m, n_words);
+}
+#endif
+
+LdCounts ld_counts(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words)
+{
+    switch (detect_isa())
+    {
+        case Isa::kAvx512:
+            return ld_counts_avx512(a, b, n_words);
+        case Isa::kAvx2:
+            return ld_counts_avx2(a, b, n_words);
+        default:
+            return ld_counts_generic(a, b, n_words);
+    }
+}
+
+TrioCounts trio_counts(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words)
+{
+    auto* kernel = &trio_counts_generic;
+    switch (detect_isa())
+    {
+        case Isa::kAvx512:
+            kernel = &trio_counts_avx512;
+            break;
+        case Isa::kAvx2:
+            kernel = &trio_counts_avx2;
+            break;
+        default:
+            break;
+    }
+    return kernel(lo_h, hi_h, lo_f, hi_f, lo_m, hi_m, n_words);
+}
+
+IbsKernel ibs_kernel()
+{
+    switch (detect_isa())
+    {
+        case Isa::kAvx512:
+            return &ibs_counts_avx512;
+        case Isa::kAvx2:
+            return &ibs_counts_avx2;
+        default:
+            return &ibs_counts_generic;
+    }
+}
+
+}  // namespace detail
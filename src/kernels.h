@@ -0,0 +1,197 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace detail
+{
+// Popcount kernels over the 2-bit bitplanes of packed.h. Each kernel has a
+// portable version plus AVX2 and AVX-512 builds selected once at runtime,
+// so one binary runs everywhere and still uses the widest popcount the CPU
+// has.
+
+enum class Isa
+{
+    kGeneric,
+    kAvx2,
+    kAvx512,
+};
+
+Isa detect_isa();
+const char* isa_name(Isa isa);
+
+// Identity-by-state tallies for one pair of samples over a run of sites:
+// `valid` sites where both are called, `ibs0` where they are opposite
+// homozygotes and `ibs2` where their genotypes are identical.
+struct IbsCounts
+{
+    uint32_t valid = 0;
+    uint32_t ibs0 = 0;
+    uint32_t ibs2 = 0;
+};
+
+using IbsKernel = void (*)(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts);
+
+IbsKernel ibs_kernel();
+
+void ibs_counts_generic(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts);
+
+void ibs_counts_avx2(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts);
+
+void ibs_counts_avx512(
+    const uint64_t* lo_a,
+    const uint64_t* hi_a,
+    const uint64_t* lo_b,
+    const uint64_t* hi_b,
+    size_t n_words,
+    IbsCounts& counts);
+
+// Pairwise-complete dosage sums for two sites, each given as three
+// bitplanes laid out back to back: het, hom-alt, then called (with padding
+// bits cleared). Dosage is het + 2 * hom-alt, so every sum below is a
+// weighted popcount; `n` is the number of samples called at both sites.
+struct LdCounts
+{
+    uint32_t n = 0;
+    uint32_t het_a = 0;
+    uint32_t hom_a = 0;
+    uint32_t het_b = 0;
+    uint32_t hom_b = 0;
+    uint32_t het_het = 0;
+    uint32_t het_hom = 0;
+    uint32_t hom_het = 0;
+    uint32_t hom_hom = 0;
+};
+
+// Dispatches on detect_isa(); the per-ISA builds are exposed so tests can
+// check them against the generic one.
+LdCounts ld_counts(const uint64_t* a, const uint64_t* b, size_t n_words);
+LdCounts ld_counts_generic(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words);
+LdCounts ld_counts_avx2(const uint64_t* a, const uint64_t* b, size_t n_words);
+LdCounts ld_counts_avx512(
+    const uint64_t* a,
+    const uint64_t* b,
+    size_t n_words);
+
+// A hybrid checked against the call its two inbred parents predict, over
+// a run of sites. A parent predicts a gamete only where it is homozygous:
+// `compared` counts sites where both parents do and the hybrid is called,
+// `discordant` those where the hybrid's genotype differs from the
+// prediction and `opposite` those where a homozygous prediction meets the
+// other homozygote.
+struct TrioCounts
+{
+    uint32_t compared = 0;
+    uint32_t discordant = 0;
+    uint32_t opposite = 0;
+};
+
+// Dispatches like ld_counts.
+TrioCounts trio_counts(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words);
+TrioCounts trio_counts_generic(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words);
+TrioCounts trio_counts_avx2(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words);
+TrioCounts trio_counts_avx512(
+    const uint64_t* lo_h,
+    const uint64_t* hi_h,
+    const uint64_t* lo_f,
+    const uint64_t* hi_f,
+    const uint64_t* lo_m,
+    const uint64_t* hi_m,
+    size_t n_words);
+
+// Log probabilities of one site of the three-state ancestry HMM: staying in
+// a state or moving to each of the other two since the previous site, and
+// a call matching or contradicting the state.
+struct HmmStep
+{
+    float log_stay = 0.F;
+    float log_switch = 0.F;
+    float log_match = 0.F;
+    float log_mismatch = 0.F;
+};
+
+// Advances the Viterbi scores of `n` samples by one site, one vector lane
+// per sample. `score` is state-major (recurrent, het, donor rows of `n`)
+// and is rescaled so every sample's best state scores 0. `obs` is the
+// state each call matches, 3 when missing. `back` receives the best
+// predecessor of each state, 2 bits per state.
+void viterbi_step(
+    float* score,
+    const uint8_t* obs,
+    const HmmStep& step,
+    uint8_t* back,
+    size_t n);
+
+// Samples per side of a tile in the pairwise kernels.
+constexpr size_t kPanelWidth = 64;
+
+// out[i][j] = sum_k a[k][i] * b[k][j] over `n_sites` rows of two
+// kPanelWidth-wide float panels (site-major, one row per site). Overwrites
+// `out`, a kPanelWidth x kPanelWidth row-major tile.
+void gram_tile_f32(
+    const float* a_panel,
+    const float* b_panel,
+    size_t n_sites,
+    float* out);
+
+// Products of one kPanelWidth-wide float panel (site-major, `n_sites` rows)
+// with a row-major double matrix `width` columns wide:
+//   panel_project:    t[s][l] += sum_i panel[s][i] * q[i][l]
+//   panel_accumulate: y[i][l] += sum_s panel[s][i] * t[s][l]
+// `q` and `y` hold the kPanelWidth rows belonging to this panel.
+void panel_project(
+    const float* panel,
+    size_t n_sites,
+    const double* q,
+    size_t width,
+    double* t);
+
+void panel_accumulate(
+    const float* panel,
+    size_t n_sites,
+    const double* t,
+    size_t width,
+    double* y);
+
+}  // namespace detail
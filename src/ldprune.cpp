@@ -0,0 +1,366 @@
+#include "ldprune.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace
+{
+bool writes_records(const std::string& path)
+{
+    return path.ends_with(".vcf") || path.ends_with(".vcf.gz")
+           || path.ends_with(".bcf");
+}
+
+std::string shard_path(const std::string& out_path, size_t shard)
+{
+    return out_path + ".shard" + std::to_string(shard) + ".tmp.bcf";
+}
+
+// Appends the per-contig files in contig order. They are uncompressed BCF
+// written from the same header, so this is a plain decode/encode loop with
+// no header translation.
+void concat_shards(
+    const std::string& out_path,
+    bcf_hdr_t* header,
+    const std::vector<std::string>& parts)
+{
+    std::string mode = vcfbox::parse_mode(out_path);
+    HtsFile out(hts_open(out_path.c_str(), mode.c_str()));
+    if (!out)
+    {
+        throw std::runtime_error("Could not open output file: " + out_path);
+    }
+    if (bcf_hdr_write(out.get(), header) != 0)
+    {
+        throw std::runtime_error("Failed to write output header");
+    }
+    BcfRec rec(bcf_init());
+    for (const auto& part : parts)
+    {
+        HtsFile in(bcf_open(part.c_str(), "r"));
+        if (!in)
+        {
+            throw std::runtime_error("Could not open shard file: " + part);
+        }
+        BcfHdr part_header(bcf_hdr_read(in.get()));
+        if (!part_header)
+        {
+            throw std::runtime_error("Could not read shard header: " + part);
+        }
+        while (bcf_read(in.get(), part_header.get(), rec.get()) == 0)
+        {
+            if (bcf_write(out.get(), header, rec.get()) != 0)
+            {
+                throw std::runtime_error("Failed to write VCF record");
+            }
+        }
+    }
+}
+
+void remove_files(const std::vector<std::string>& paths)
+{
+    for (const auto& path : paths)
+    {
+        std::remove(path.c_str());
+    }
+}
+
+}  // namespace
+
+namespace vcfbox
+{
+void ld_prune(
+    const std::string& vcf_path,
+    const std::string& out_path,
+    size_t window,
+    size_t step,
+    double max_r2,
+    size_t n_threads)
+{
+    if (window < 2 || step == 0 || step > window)
+    {
+        throw std::runtime_error(
+            "LD window needs at least two sites and a step in [1, window]");
+    }
+
+    detail::RegionReader probe(vcf_path);
+    size_t n_samples = bcf_hdr_nsamples(probe.header());
+    if (n_samples == 0)
+    {
+        throw std::runtime_error("VCF file has no samples: " + vcf_path);
+    }
+    auto regions = detail::contig_regions(probe);
+    bool record_mode = writes_records(out_path);
+    // one region is written straight to the output, several go through one
+    // temporary file per contig that is appended once all are done
+    bool direct = regions.size() == 1;
+
+    std::ofstream keep_stream;
+    if (!record_mode)
+    {
+        keep_stream.open(out_path);
+        if (!keep_stream)
+        {
+            throw std::runtime_error("Failed to open output file: " + out_path);
+        }
+        keep_stream << "chrom\tpos\tid\tref\talt\n";
+    }
+    detail::OrderedWriter keep_writer(keep_stream);
+    std::vector<char> shard_written(regions.size());
+
+    std::atomic<size_t> processd_snp = 0;
+    auto counter = detail::create_counter("Pruning by LD", processd_snp);
+    counter->show();
+    auto prune_region =
+        [&](size_t, size_t shard, detail::RegionReader& reader)
+    {
+        bcf_hdr_t* header = reader.header();
+        detail::LdWindow sites(n_samples, window);
+        std::vector<BcfRec> recs;
+        recs.reserve(window);
+        for (size_t i = 0; i < window; ++i)
+        {
+            recs.emplace_back(bcf_init());
+        }
+        std::vector<char> pruned(window);
+        Genotypes gt;
+        HtsFile shard_file;
+        std::string chunk;
+
+        auto open_shard_file = [&]()
+        {
+            std::string path = direct ? out_path : shard_path(out_path, shard);
+            std::string mode = direct ? parse_mode(out_path) : "wbu";
+            shard_file.reset(hts_open(path.c_str(), mode.c_str()));
+            if (!shard_file)
+            {
+                throw std::runtime_error("Could not open output file: " + path);
+            }
+            shard_written[shard] = 1;
+            if (bcf_hdr_write(shard_file.get(), header) != 0)
+            {
+                throw std::runtime_error("Failed to write output header");
+            }
+        };
+        // the output exists even when every site is pruned
+        if (record_mode && direct)
+        {
+            open_shard_file();
+        }
+
+        // a site is final once the window has moved past it
+        auto emit = [&](size_t ordinal)
+        {
+            size_t slot = ordinal % window;
+            if (pruned[slot] != 0)
+            {
+                return;
+            }
+            bcf1_t* rec = recs[slot].get();
+            if (!record_mode)
+            {
+                std::format_to(
+                    std::back_inserter(chunk),
+                    "{}\t{}\t{}\t{}\t{}\n",
+                    bcf_hdr_id2name(header, rec->rid),
+                    rec->pos + 1,
+                    rec->d.id,
+                    rec->d.allele[0],
+                    rec->n_allele > 1 ? rec->d.allele[1] : ".");
+                if (chunk.size() >= (1 << 20))
+                {
+                    keep_writer.write(shard, chunk);
+                }
+                return;
+            }
+            if (!shard_file)
+            {
+                open_shard_file();
+            }
+            if (bcf_write(shard_file.get(), header, rec) != 0)
+            {
+                throw std::runtime_error("Failed to write VCF record");
+            }
+        };
+
+        // sites [oldest, next) are buffered, [win_start, next) is the
+        // part of the current window seen so far
+        size_t oldest = 0;
+        size_t next = 0;
+        size_t win_start = 0;
+        int rid = -1;
+        size_t local = 0;
+        while (true)
+        {
+            while (next >= win_start + window)
+            {
+                win_start += step;
+            }
+            for (; oldest < win_start; ++oldest)
+            {
+                emit(oldest);
+            }
+
+            bcf1_t* rec = recs[next % window].get();
+            int n_gt = detail::next_biallelic_gt(reader, rec, gt);
+            if (n_gt == 0)
+            {
+                break;
+            }
+            if (++local == 4096)
+            {
+                processd_snp += local;
+                local = 0;
+            }
+            // an unindexed input is read as one region, LD never spans
+            // a contig boundary
+            if (rec->rid != rid)
+            {
+                for (; oldest < next; ++oldest)
+                {
+                    emit(oldest);
+                }
+                win_start = next;
+                rid = rec->rid;
+            }
+
+            sites.set_site(next, gt.p_, n_gt);
+            pruned[next % window] = 0;
+            for (size_t i = win_start; i < next; ++i)
+            {
+                if (pruned[i % window] != 0 || sites.r2(i, next) <= max_r2)
+                {
+                    continue;
+                }
+                if (sites.maf(i) < sites.maf(next))
+                {
+                    pruned[i % window] = 1;
+                }
+                else
+                {
+                    pruned[next % window] = 1;
+                    break;
+                }
+            }
+            ++next;
+        }
+        for (; oldest < next; ++oldest)
+        {
+            emit(oldest);
+        }
+        processd_snp += local;
+        if (!record_mode)
+        {
+            keep_writer.write(shard, chunk);
+            keep_writer.finish(shard);
+        }
+    };
+
+    auto shard_files = [&]()
+    {
+        std::vector<std::string> parts;
+        for (size_t shard = 0; shard < regions.size(); ++shard)
+        {
+            if (!direct && shard_written[shard] != 0)
+            {
+                parts.push_back(shard_path(out_path, shard));
+            }
+        }
+        return parts;
+    };
+    try
+    {
+        detail::for_each_region(
+            vcf_path, regions, n_threads, prune_region, &keep_writer);
+        counter->done();
+        if (record_mode && !direct)
+        {
+            concat_shards(out_path, probe.header(), shard_files());
+        }
+    }
+    catch (...)
+    {
+        remove_files(shard_files());
+        throw;
+    }
+    remove_files(shard_files());
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+LdWindow::LdWindow(size_t n_samples, size_t capacity)
+    : n_samples_(n_samples),
+      n_words_(words_for(n_samples)),
+      capacity_(capacity),
+      planes_(capacity * 3 * n_words_),
+      lo_(n_words_),
+      hi_(n_words_),
+      maf_(capacity)
+{
+}
+
+void LdWindow::set_site(size_t ordinal, const int32_t* gt_arr, int n_gt)
+{
+    pack_site(
+        gt_arr, n_gt, static_cast<int>(n_samples_), lo_.data(), hi_.data());
+    size_t slot = ordinal % capacity_;
+    uint64_t* het = planes_.data() + (slot * 3 * n_words_);
+    uint64_t* hom = het + n_words_;
+    uint64_t* call = hom + n_words_;
+    for (size_t w = 0; w < n_words_; ++w)
+    {
+        het[w] = lo_[w] & ~hi_[w];
+        hom[w] = hi_[w] & ~lo_[w];
+        call[w] = ~(lo_[w] & hi_[w]);
+    }
+    // padding reads as 0/0 in the packed planes, it must not count as called
+    if (n_samples_ % 64 != 0)
+    {
+        call[n_words_ - 1] &= (uint64_t{1} << (n_samples_ % 64)) - 1;
+    }
+
+    auto counts = count_site(lo_.data(), hi_.data(), n_samples_);
+    double af = counts.called() == 0
+                    ? 0.
+                    : static_cast<double>(counts.alt_alleles())
+                          / (2. * static_cast<double>(counts.called()));
+    maf_[slot] = std::min(af, 1. - af);
+}
+
+double LdWindow::r2(size_t a, size_t b) const
+{
+    LdCounts c = ld_counts(planes(a), planes(b), n_words_);
+    double n = c.n;
+    double sx = c.het_a + (2. * c.hom_a);
+    double sxx = c.het_a + (4. * c.hom_a);
+    double sy = c.het_b + (2. * c.hom_b);
+    double syy = c.het_b + (4. * c.hom_b);
+    double sxy = c.het_het + (2. * (c.het_hom + c.hom_het))
+                 + (4. * c.hom_hom);
+    double var_x = (n * sxx) - (sx * sx);
+    double var_y = (n * syy) - (sy * sy);
+    if (var_x <= 0 || var_y <= 0)
+    {
+        return 0.;
+    }
+    double cov = (n * sxy) - (sx * sy);
+    return (cov * cov) / (var_x * var_y);
+}
+
+}  // namespace detail
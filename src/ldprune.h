@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernels.h"
+
+namespace vcfbox
+{
+// PLINK-style --indep-pairwise pruning of biallelic sites. The window spans
+// `window` consecutive sites on one contig and advances by `step`; within
+// it, whenever two unpruned sites have r^2 above `max_r2` the one with the
+// lower minor allele frequency is dropped. Contigs are pruned in parallel
+// when the input is indexed.
+//
+// `out_path` ending in .vcf, .vcf.gz or .bcf receives the kept records,
+// anything else gets a keep-list of chrom, pos, id, ref and alt.
+void ld_prune(
+    const std::string& vcf_path,
+    const std::string& out_path,
+    size_t window,
+    size_t step,
+    double max_r2,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// The last `capacity` sites of a contig, each stored as the het, hom-alt
+// and called bitplanes ld_counts() takes. Site ordinal k lives in slot
+// k % capacity, so the window slides without moving any data.
+class LdWindow
+{
+   public:
+    LdWindow(size_t n_samples, size_t capacity);
+
+    size_t capacity() const { return capacity_; }
+
+    // Packs a bcf_get_genotypes() array into the slot of site `ordinal`
+    // and records its minor allele frequency.
+    void set_site(size_t ordinal, const int32_t* gt_arr, int n_gt);
+
+    // Squared correlation of dosages over samples called at both sites,
+    // 0 when either site is constant among them.
+    double r2(size_t a, size_t b) const;
+    double maf(size_t ordinal) const { return maf_[ordinal % capacity_]; }
+
+   private:
+    const uint64_t* planes(size_t ordinal) const
+    {
+        return planes_.data() + ((ordinal % capacity_) * 3 * n_words_);
+    }
+
+    size_t n_samples_;
+    size_t n_words_;
+    size_t capacity_;
+    std::vector<uint64_t> planes_;
+    std::vector<uint64_t> lo_;
+    std::vector<uint64_t> hi_;
+    std::vector<double> maf_;
+};
+
+}  // namespace detail
@@ -1,4 +1,16 @@
 #include "CLI11.hpp"
+#include "distance.h"
+#include "filter.h"
+#include "grm.h"
+#include "impute.h"
+#include "ldprune.h"
+#include "markers.h"
+#include "parentage.h"
+#include "pca.h"
+#include "popgen.h"
+#include "segments.h"
+#include "simulate.h"
+#include "stats.h"
 #include "utils.h"
 #include "vcf.h"
 
@@ -9,8 +21,95 @@ int main(int argc, char** argv)
     app.require_subcommand(1);
     std::string vcf;
     std::string paired_sample;
+    std::string females;
+    std::string males;
+    std::string diallel;
+    std::string diallel_mode = "half";
     std::string output;
     bool keep_old_samples = false;
+    bool drop_monomorphic = false;
+    bool profile = false;
+    bool perf_counters = false;
+    std::string hybrid_summary;
+    size_t threads = 1;
+    bool variant_stats = false;
+    bool genotype_stats = false;
+    std::string stats_output = "count_stats.tsv";
+    std::string stats_prefix = "stats";
+    std::string dist_prefix = "distance";
+    std::string dist_metric = "ibs";
+    bool binary_output = false;
+    std::string grm_prefix = "grm";
+    std::string prune_output = "ld_prune.keep";
+    size_t ld_window = 50;
+    size_t ld_step = 5;
+    double ld_r2 = 0.2;
+    std::string pca_prefix = "pca";
+    size_t pca_components = 10;
+    size_t pca_oversample = 10;
+    size_t pca_iterations = 6;
+    std::string groups;
+    std::string popgen_output = "popgen.tsv";
+    int64_t popgen_window = 100'000;
+    int64_t popgen_step = 0;
+    detail::FilterOptions filters;
+    detail::ImputeOptions impute;
+    std::string trios;
+    std::string verify_output = "verify_hybrids.tsv";
+    std::string parents;
+    std::string hybrids;
+    std::string parents_output = "find_parents.tsv";
+    size_t max_markers = 20'000;
+    size_t n_candidates = 32;
+    std::string markers_output = "markers.tsv";
+    std::string marker_target = "hybrids";
+    size_t max_selected = 0;
+    std::string donor;
+    std::string recurrent;
+    std::string progeny;
+    std::string segments_output = "segments.bed";
+    detail::SegmentOptions segment_options;
+    std::string p1;
+    std::string p2;
+    std::string progeny_output = "progeny.vcf.gz";
+    detail::CrossOptions cross_options;
+    std::string simulate_output = "simulated.vcf.gz";
+    detail::SimulateOptions simulate_options;
+
+    // the same QC thresholds on every subcommand that streams records out
+    auto add_filter_options = [&](CLI::App* sub)
+    {
+        sub
+            ->add_option(
+                "--min-maf", filters.min_maf, "Drop sites with a lower MAF.")
+            ->check(CLI::Range(0., .5));
+        sub
+            ->add_option(
+                "--max-missing",
+                filters.max_missing,
+                "Drop sites with a higher fraction of missing calls.")
+            ->check(CLI::Range(0., 1.));
+        sub
+            ->add_option(
+                "--max-het",
+                filters.max_het,
+                "Drop sites with a higher fraction of heterozygous calls.")
+            ->check(CLI::Range(0., 1.));
+        sub
+            ->add_option(
+                "--max-sample-missing",
+                filters.max_sample_missing,
+                "Drop samples with a higher fraction of missing calls, costs "
+                "one extra pass.")
+            ->check(CLI::Range(0., 1.));
+        sub
+            ->add_option(
+                "--max-sample-het",
+                filters.max_sample_het,
+                "Drop samples with a higher fraction of heterozygous calls, "
+                "costs one extra pass.")
+            ->check(CLI::Range(0., 1.));
+    };
 
     auto* combine = app.add_subcommand(
         "combine", "Combine genotypes from paired samples in a VCF file");
@@ -20,15 +119,62 @@ int main(int argc, char** argv)
     auto* convert = app.add_subcommand(
         "convert", "Convert VCF to various formats (e.g., HapMap)");
 
+    auto* stats = app.add_subcommand(
+        "stats",
+        "Per-site allele frequency, call rate and heterozygosity, and "
+        "per-sample call rate and heterozygosity");
+
     count->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
+    count->add_flag(
+        "-s,--stats",
+        variant_stats,
+        "Report per-contig SNP/MNP/indel/multi-allelic and Ti/Tv counts "
+        "instead of a single record count.");
+    count->add_flag(
+        "-g,--genotype-stats",
+        genotype_stats,
+        "Also decode genotypes and report missing-GT rates, implies "
+        "--stats.");
+    count
+        ->add_option(
+            "-o,--output", stats_output, "Path to output stats TSV file.")
+        ->capture_default_str();
+    count
+        ->add_option(
+            "-t,--threads",
+            threads,
+            "Number of worker threads, regions are only sharded when the "
+            "input is indexed.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
     combine->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
+    auto* pairs_opt = combine->add_option(
+        "-p,--paired-sample",
+        paired_sample,
+        "Path to file with paired samples, one pair per line, separated by "
+        "space.");
+    auto* females_opt = combine->add_option(
+        "--females",
+        females,
+        "Sample list of female parents, crossed with every male (full "
+        "factorial).");
+    auto* males_opt = combine->add_option(
+        "--males", males, "Sample list of male parents, see --females.");
+    auto* diallel_opt = combine->add_option(
+        "--diallel",
+        diallel,
+        "Sample list crossed in a diallel, see --diallel-mode.");
     combine
         ->add_option(
-            "-p,--paired-sample",
-            paired_sample,
-            "Path to file with paired samples, one pair per line, separated by "
-            "space.")
-        ->required();
+            "--diallel-mode",
+            diallel_mode,
+            "half: each unordered pair once, full: reciprocal crosses too.")
+        ->capture_default_str()
+        ->check(CLI::IsMember({"half", "full"}));
+    females_opt->needs(males_opt);
+    males_opt->needs(females_opt);
+    pairs_opt->excludes(females_opt, diallel_opt);
+    diallel_opt->excludes(females_opt);
     combine
         ->add_option(
             "-o,--output",
@@ -41,6 +187,45 @@ int main(int argc, char** argv)
         "-k,--keep-old-samples",
         keep_old_samples,
         "Keep old samples in the output VCF file, default is false.");
+    combine->add_flag(
+        "-m,--drop-monomorphic",
+        drop_monomorphic,
+        "Skip sites where all output genotypes are identical or missing.");
+    auto* profile_opt = combine->add_flag(
+        "--profile",
+        profile,
+        "Print the time spent in each stage of the record loop.");
+    combine
+        ->add_flag(
+            "--perf-counters",
+            perf_counters,
+            "Also count cycles, instructions, LLC and branch misses per "
+            "stage (Linux perf events, NA where not permitted).")
+        ->needs(profile_opt);
+    combine->add_option(
+        "--summary",
+        hybrid_summary,
+        "Path to a per-hybrid TSV of call rate and heterozygosity over the "
+        "written sites.");
+    auto* impute_opt = combine->add_flag(
+        "--impute",
+        impute.enabled,
+        "Fill missing parent calls by LD-kNN imputation before crossing.");
+    combine
+        ->add_option(
+            "--impute-sites",
+            impute.ld_sites,
+            "Flanking sites in highest LD the neighbour distance uses.")
+        ->capture_default_str()
+        ->check(CLI::Range(size_t{1}, 2 * detail::KnnImputer::kFlank))
+        ->needs(impute_opt);
+    combine
+        ->add_option(
+            "--impute-k", impute.k, "Neighbours voting on a missing call.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber)
+        ->needs(impute_opt);
+    add_filter_options(combine);
 
     convert->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
     convert
@@ -50,6 +235,390 @@ int main(int argc, char** argv)
             "Path to output file, if not provided, will be the same as input "
             "VCF file.")
         ->default_str("output.hmp");
+    add_filter_options(convert);
+
+    auto* distance = app.add_subcommand(
+        "distance", "Pairwise IBS distance matrix between all samples");
+
+    auto* grm = app.add_subcommand(
+        "grm", "VanRaden genomic relationship matrix between all samples");
+
+    stats->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
+    stats
+        ->add_option(
+            "-o,--output",
+            stats_prefix,
+            "Output prefix, writes <prefix>.site.tsv and <prefix>.sample.tsv.")
+        ->capture_default_str();
+    stats
+        ->add_option(
+            "-t,--threads",
+            threads,
+            "Number of worker threads, regions are only sharded when the "
+            "input is indexed.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    distance->add_option("-v,--vcf", vcf, "Path to input VCF file")
+        ->required();
+    distance
+        ->add_option(
+            "-o,--output",
+            dist_prefix,
+            "Output prefix, writes <prefix>.dist (or .dist.bin) and "
+            "<prefix>.dist.id.")
+        ->capture_default_str();
+    distance
+        ->add_option(
+            "-m,--metric",
+            dist_metric,
+            "ibs: 1 - IBS similarity, ibs0: fraction of opposite "
+            "homozygotes, both over sites called in the pair.")
+        ->capture_default_str()
+        ->check(CLI::IsMember({"ibs", "ibs0"}));
+    distance->add_flag(
+        "-b,--binary",
+        binary_output,
+        "Write a row-major float32 matrix instead of text.");
+    distance
+        ->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    grm->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
+    grm->add_option(
+           "-o,--output",
+           grm_prefix,
+           "Output prefix, writes <prefix>.grm.bin (float32, n x n) and "
+           "<prefix>.grm.id.")
+        ->capture_default_str();
+    grm->add_option(
+        "-p,--paired-sample",
+        paired_sample,
+        "Compute the GRM among the hybrids of this pairs file (same format "
+        "as combine) from their parents, without building a hybrid VCF.");
+    grm->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* ld_prune = app.add_subcommand(
+        "ld-prune", "Prune sites in linkage disequilibrium within a window");
+    ld_prune->add_option("-v,--vcf", vcf, "Path to input VCF file")
+        ->required();
+    ld_prune
+        ->add_option(
+            "-o,--output",
+            prune_output,
+            "Output path, .vcf/.vcf.gz/.bcf writes the kept records, any other "
+            "extension a keep-list.")
+        ->capture_default_str();
+    ld_prune->add_option("-w,--window", ld_window, "Window size in sites.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    ld_prune
+        ->add_option(
+            "-s,--step", ld_step, "Sites the window advances at a time.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    ld_prune
+        ->add_option(
+            "-r,--r2",
+            ld_r2,
+            "Prune the rarer site of any pair with r^2 above this.")
+        ->capture_default_str()
+        ->check(CLI::Range(0., 1.));
+    ld_prune
+        ->add_option(
+            "-t,--threads",
+            threads,
+            "Number of worker threads, contigs are only pruned in parallel "
+            "when the input is indexed.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* pca = app.add_subcommand(
+        "pca", "Top principal components by out-of-core randomized PCA");
+    pca->add_option(
+           "-v,--vcf",
+           vcf,
+           "Path to input VCF file, usually LD-pruned with ld-prune first")
+        ->required();
+    pca->add_option(
+           "-o,--output",
+           pca_prefix,
+           "Output prefix, writes <prefix>.eigenvec and <prefix>.eigenval.")
+        ->capture_default_str();
+    pca->add_option(
+           "-k,--components", pca_components, "Number of components.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    pca->add_option(
+           "--oversample",
+           pca_oversample,
+           "Extra basis vectors carried along to speed up convergence.")
+        ->capture_default_str();
+    pca->add_option(
+           "-i,--iterations",
+           pca_iterations,
+           "Subspace iterations, each one pass over the input.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    pca->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* popgen = app.add_subcommand(
+        "popgen",
+        "Windowed diversity and Tajima's D per group, Hudson Fst between "
+        "groups");
+    popgen->add_option("-v,--vcf", vcf, "Path to input VCF file")
+        ->required();
+    popgen
+        ->add_option(
+            "-g,--groups",
+            groups,
+            "File with one sample and its group per line, separated by "
+            "space.")
+        ->required();
+    popgen->add_option("-o,--output", popgen_output, "Path to output TSV.")
+        ->capture_default_str();
+    popgen->add_option("-w,--window", popgen_window, "Window size in bp.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    popgen
+        ->add_option(
+            "-s,--step",
+            popgen_step,
+            "Window step in bp, 0 for non-overlapping windows.")
+        ->capture_default_str()
+        ->check(CLI::NonNegativeNumber);
+    popgen
+        ->add_option(
+            "-t,--threads",
+            threads,
+            "Number of worker threads, regions are only sharded when the "
+            "input is indexed.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* verify = app.add_subcommand(
+        "verify-hybrids",
+        "Check sequenced hybrids against the genotypes their parents "
+        "predict");
+    verify->add_option("-v,--vcf", vcf, "Path to input VCF file")
+        ->required();
+    verify
+        ->add_option(
+            "-p,--trios",
+            trios,
+            "File with one hybrid, its female and its male parent per line, "
+            "separated by space.")
+        ->required();
+    verify
+        ->add_option("-o,--output", verify_output, "Path to output TSV.")
+        ->capture_default_str();
+    verify
+        ->add_option(
+            "-t,--threads",
+            threads,
+            "Number of worker threads, regions are only sharded when the "
+            "input is indexed.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* find = app.add_subcommand(
+        "find-parents",
+        "Find the pair of inbred lines that best explains each hybrid");
+    find->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
+    find->add_option("--parents", parents, "Sample list of candidate parents.")
+        ->required();
+    find->add_option(
+        "--hybrids",
+        hybrids,
+        "Sample list of hybrids to assign, default is every other sample.");
+    find->add_option("-o,--output", parents_output, "Path to output TSV.")
+        ->capture_default_str();
+    find
+        ->add_option(
+            "--markers",
+            max_markers,
+            "Maximum number of polymorphic sites kept, spread evenly over "
+            "the file.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    find
+        ->add_option(
+            "--candidates",
+            n_candidates,
+            "Single parents per hybrid kept for the pair search.")
+        ->capture_default_str()
+        ->check(CLI::Range(size_t{2}, size_t{4096}));
+    find->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* select = app.add_subcommand(
+        "select-markers",
+        "Pick a small marker panel that tells apart the parents or hybrids");
+    select->add_option("-v,--vcf", vcf, "Path to input VCF file")->required();
+    select
+        ->add_option(
+            "-p,--paired-sample",
+            paired_sample,
+            "Pairs file (same format as combine) naming the crosses.")
+        ->required();
+    select->add_option("-o,--output", markers_output, "Path to output TSV.")
+        ->capture_default_str();
+    select
+        ->add_option(
+            "--target", marker_target, "Items the panel must tell apart.")
+        ->capture_default_str()
+        ->check(CLI::IsMember({"parents", "hybrids"}));
+    select
+        ->add_option(
+            "-n,--max-markers",
+            max_selected,
+            "Stop after this many markers, 0 for no cap.")
+        ->capture_default_str();
+    select->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* segments = app.add_subcommand(
+        "segments",
+        "Call donor, recurrent and het segments in backcross or RIL progeny");
+    segments->add_option("-v,--vcf", vcf, "Path to input VCF file")
+        ->required();
+    segments->add_option("--donor", donor, "Donor parent sample.")
+        ->required();
+    segments->add_option("--recurrent", recurrent, "Recurrent parent sample.")
+        ->required();
+    segments->add_option(
+        "--samples",
+        progeny,
+        "Sample list of progeny, default is every sample but the parents.");
+    segments->add_option("-o,--output", segments_output, "Path to output BED.")
+        ->capture_default_str();
+    segments
+        ->add_option(
+            "--recomb-rate",
+            segment_options.recomb_rate,
+            "Recombination rate in cM per Mb.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    segments
+        ->add_option(
+            "--error-rate",
+            segment_options.error_rate,
+            "Chance that a call contradicts its segment.")
+        ->capture_default_str()
+        ->check(CLI::Range(0., .5));
+    segments->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* sim_cross = app.add_subcommand(
+        "simulate-cross",
+        "Simulate F2, backcross or RIL progeny of two inbred lines");
+    sim_cross->add_option("-v,--vcf", vcf, "Path to input VCF file")
+        ->required();
+    sim_cross->add_option("--p1", p1, "First parent, the recurrent one for bc.")
+        ->required();
+    sim_cross->add_option("--p2", p2, "Second parent.")->required();
+    sim_cross
+        ->add_option(
+            "-o,--output",
+            progeny_output,
+            "Path to output VCF/BCF, the format follows the extension.")
+        ->capture_default_str();
+    sim_cross->add_option("--type", cross_options.type, "Cross type.")
+        ->capture_default_str()
+        ->check(CLI::IsMember({"f2", "bc", "ril"}));
+    sim_cross
+        ->add_option(
+            "-n,--progeny", cross_options.n_progeny, "Number of progeny.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    sim_cross->add_option(
+        "--generations",
+        cross_options.generations,
+        "Backcrosses for bc or selfings for ril, default 1 and 7 (F8).");
+    sim_cross->add_option("--seed", cross_options.seed, "Random seed.")
+        ->capture_default_str();
+    sim_cross
+        ->add_option(
+            "--map",
+            cross_options.map_path,
+            "Genetic map with \"chrom pos cM\" lines.")
+        ->check(CLI::ExistingFile);
+    sim_cross
+        ->add_option(
+            "--recomb-rate",
+            cross_options.recomb_rate,
+            "Recombination rate in cM per Mb on contigs without a map.")
+        ->capture_default_str()
+        ->check(CLI::NonNegativeNumber);
+    sim_cross->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+
+    auto* simulate = app.add_subcommand(
+        "simulate", "Write a synthetic VCF/BCF of any size for benchmarks");
+    simulate
+        ->add_option(
+            "-o,--output",
+            simulate_output,
+            "Path to output VCF/BCF, the format follows the extension.")
+        ->capture_default_str();
+    simulate
+        ->add_option(
+            "--samples", simulate_options.n_samples, "Number of samples.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    simulate
+        ->add_option("--sites", simulate_options.n_sites, "Number of sites.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    simulate
+        ->add_option(
+            "--contigs",
+            simulate_options.n_contigs,
+            "Number of contigs the sites are spread over.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
+    simulate
+        ->add_option(
+            "--missing", simulate_options.missing, "Fraction of missing calls.")
+        ->capture_default_str()
+        ->check(CLI::Range(0., 1.));
+    simulate
+        ->add_option(
+            "--het",
+            simulate_options.het,
+            "Heterozygosity relative to Hardy-Weinberg (1 - F): a site at "
+            "ALT frequency p has 2p(1 - p) times this fraction of het "
+            "calls.")
+        ->capture_default_str()
+        ->check(CLI::Range(0., 1.));
+    simulate
+        ->add_option(
+            "--multiallelic",
+            simulate_options.multiallelic,
+            "Fraction of sites with two ALT alleles.")
+        ->capture_default_str()
+        ->check(CLI::Range(0., 1.));
+    simulate
+        ->add_option(
+            "--afs",
+            simulate_options.afs,
+            "ALT allele frequency spectrum, neutral (1/p) or uniform.")
+        ->capture_default_str()
+        ->check(CLI::IsMember({"neutral", "uniform"}));
+    simulate->add_option("--seed", simulate_options.seed, "Random seed.")
+        ->capture_default_str();
+    simulate->add_option("-t,--threads", threads, "Number of worker threads.")
+        ->capture_default_str()
+        ->check(CLI::PositiveNumber);
     CLI11_PARSE(app, argc, argv);
 
     if (*combine)
@@ -57,9 +626,43 @@ int main(int argc, char** argv)
         std::string mode = vcfbox::parse_mode(output);
         try
         {
-            auto pairs = vcfbox::parse_sample_pairs(paired_sample);
+            auto design = [&]()
+            {
+                if (!paired_sample.empty())
+                {
+                    return detail::CrossDesign::from_pairs(
+                        vcfbox::parse_sample_pairs(paired_sample));
+                }
+                if (!females.empty())
+                {
+                    return detail::CrossDesign::factorial(
+                        vcfbox::parse_sample_list(females),
+                        vcfbox::parse_sample_list(males));
+                }
+                if (diallel.empty())
+                {
+                    throw std::runtime_error(
+                        "One of --paired-sample, --females/--males or "
+                        "--diallel is required");
+                }
+                auto parents = vcfbox::parse_sample_list(diallel);
+                return diallel_mode == "full"
+                           ? detail::CrossDesign::full_diallel(parents)
+                           : detail::CrossDesign::half_diallel(parents);
+            }();
             vcfbox::combine_genotypes(
-                vcf, pairs, keep_old_samples, output, mode);
+                vcf,
+                std::move(design),
+                keep_old_samples,
+                drop_monomorphic,
+                output,
+                hybrid_summary,
+                filters,
+                impute,
+                mode,
+                perf_counters ? detail::ProfileMode::kCounters
+                : profile     ? detail::ProfileMode::kStages
+                              : detail::ProfileMode::kOff);
         }
         catch (const std::exception& e)
         {
@@ -69,7 +672,22 @@ int main(int argc, char** argv)
     }
     else if (*count)
     {
-        vcfbox::count_records(vcf);
+        try
+        {
+            if (variant_stats || genotype_stats)
+            {
+                vcfbox::count_stats(vcf, stats_output, genotype_stats, threads);
+            }
+            else
+            {
+                vcfbox::count_records(vcf);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
     }
     else if (*convert)
     {
@@ -77,7 +695,7 @@ int main(int argc, char** argv)
         {
             if (output.substr(output.find_last_of('.') + 1) == "hmp")
             {
-                vcfbox::to_hapmap(vcf, output);
+                vcfbox::to_hapmap(vcf, output, filters);
             }
             else
             {
@@ -91,6 +709,193 @@ int main(int argc, char** argv)
             return 1;
         }
     }
+    else if (*stats)
+    {
+        try
+        {
+            vcfbox::qc_stats(vcf, stats_prefix, threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*distance)
+    {
+        try
+        {
+            vcfbox::distance_matrix(
+                vcf, dist_prefix, dist_metric, binary_output, threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*grm)
+    {
+        try
+        {
+            if (paired_sample.empty())
+            {
+                vcfbox::grm(vcf, grm_prefix, threads);
+            }
+            else
+            {
+                auto pairs = vcfbox::parse_sample_pairs(paired_sample);
+                vcfbox::hybrid_grm(vcf, pairs, grm_prefix, threads);
+            }
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*ld_prune)
+    {
+        try
+        {
+            vcfbox::ld_prune(
+                vcf, prune_output, ld_window, ld_step, ld_r2, threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*pca)
+    {
+        try
+        {
+            vcfbox::pca(
+                vcf,
+                pca_prefix,
+                pca_components,
+                pca_oversample,
+                pca_iterations,
+                threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*popgen)
+    {
+        try
+        {
+            vcfbox::popgen(
+                vcf,
+                groups,
+                popgen_output,
+                popgen_window,
+                popgen_step == 0 ? popgen_window : popgen_step,
+                threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*verify)
+    {
+        try
+        {
+            vcfbox::verify_hybrids(vcf, trios, verify_output, threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*find)
+    {
+        try
+        {
+            vcfbox::find_parents(
+                vcf,
+                parents,
+                hybrids,
+                parents_output,
+                max_markers,
+                n_candidates,
+                threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*select)
+    {
+        try
+        {
+            vcfbox::select_markers(
+                vcf,
+                paired_sample,
+                markers_output,
+                marker_target,
+                max_selected,
+                threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*segments)
+    {
+        try
+        {
+            vcfbox::segments(
+                vcf,
+                donor,
+                recurrent,
+                progeny,
+                segments_output,
+                segment_options,
+                threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*sim_cross)
+    {
+        try
+        {
+            vcfbox::simulate_cross(
+                vcf, p1, p2, progeny_output, cross_options, threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
+    else if (*simulate)
+    {
+        try
+        {
+            vcfbox::simulate_vcf(simulate_output, simulate_options, threads);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error: " << e.what() << '\n';
+            return 1;
+        }
+    }
 
     return 0;
 }
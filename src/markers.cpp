@@ -0,0 +1,299 @@
+#include "markers.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <queue>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "cross.h"
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf.h"
+#include "vcf_raii.h"
+
+namespace
+{
+// A candidate's gain as of `round` markers chosen; gains only shrink as
+// pairs get covered, so a stale gain is an upper bound.
+struct Candidate
+{
+    uint64_t gain;
+    size_t site;
+    size_t round;
+
+    bool operator<(const Candidate& other) const
+    {
+        // earlier sites win ties, for a reproducible panel
+        return gain < other.gain || (gain == other.gain && site > other.site);
+    }
+};
+
+}  // namespace
+
+namespace vcfbox
+{
+void select_markers(
+    const std::string& vcf_path,
+    const std::string& pairs_path,
+    const std::string& out_path,
+    const std::string& target,
+    size_t max_markers,
+    size_t n_threads)
+{
+    if (target != "parents" && target != "hybrids")
+    {
+        throw std::runtime_error("Unsupported marker target: " + target);
+    }
+    bool hybrids = target == "hybrids";
+    detail::RegionReader reader(vcf_path);
+    reader.seek(detail::Region{});
+    int n_samples = bcf_hdr_nsamples(reader.header());
+    auto design
+        = detail::CrossDesign::from_pairs(parse_sample_pairs(pairs_path));
+    design.bind(reader.header());
+
+    std::vector<int> parents;
+    design.for_each(
+        [&](size_t i, size_t j)
+        {
+            parents.push_back(design.first_sample(i));
+            parents.push_back(design.second_sample(j));
+        });
+    std::sort(parents.begin(), parents.end());
+    parents.erase(std::unique(parents.begin(), parents.end()), parents.end());
+    size_t n_items = hybrids ? design.size() : parents.size();
+    if (n_items < 2)
+    {
+        throw std::runtime_error(
+            "Marker selection needs at least two " + target + " in: "
+            + pairs_path);
+    }
+
+    size_t n_words = detail::words_for(n_items);
+    size_t site_size = 2 * n_words;
+    std::vector<uint64_t> planes;
+    std::vector<std::string> sites;
+    std::priority_queue<Candidate> heap;
+    std::vector<int32_t> item_gts;
+    BcfRec rec(bcf_init());
+    Genotypes gt;
+    size_t processd_snp = 0;
+    auto counter = detail::create_counter("Reading candidates", processd_snp);
+    counter->show();
+    while (true)
+    {
+        int n_gt = detail::next_biallelic_gt(reader, rec.get(), gt);
+        if (n_gt == 0)
+        {
+            break;
+        }
+        processd_snp++;
+        // the calls combine would write for the items, parents as they are
+        // or predicted hybrids
+        if (hybrids)
+        {
+            detail::concat_gt(design, gt.p_, false, n_gt, item_gts);
+        }
+        else
+        {
+            int ploidy = n_gt / n_samples;
+            item_gts.clear();
+            for (int sample : parents)
+            {
+                const int32_t* call = gt.p_ + (sample * ploidy);
+                item_gts.push_back(call[0]);
+                item_gts.push_back(ploidy > 1 ? call[1] : call[0]);
+            }
+        }
+        size_t base = planes.size();
+        planes.resize(base + site_size);
+        detail::pack_site(
+            item_gts.data(),
+            static_cast<int>(item_gts.size()),
+            static_cast<int>(n_items),
+            planes.data() + base,
+            planes.data() + base + n_words);
+        auto c = detail::count_site(
+            planes.data() + base, planes.data() + base + n_words, n_items);
+        // against a fully unresolved set the gain has a closed form
+        uint64_t gain = (c.hom_ref * c.het) + (c.hom_ref * c.hom_alt)
+                        + (c.het * c.hom_alt);
+        if (gain == 0)
+        {
+            planes.resize(base);
+            continue;
+        }
+        heap.push({gain, sites.size(), 0});
+        sites.push_back(std::format(
+            "{}\t{}\t{}\t{}\t{}",
+            bcf_hdr_id2name(reader.header(), rec->rid),
+            rec->pos + 1,
+            rec->d.id,
+            rec->d.allele[0],
+            rec->d.allele[1]));
+    }
+    counter->done();
+
+    std::ofstream stream(out_path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + out_path);
+    }
+    stream << "chrom\tpos\tid\tref\talt\tn_resolved\tn_unresolved\n";
+
+    // lazy greedy: only the top of the heap is re-scored, a fresh top is
+    // the best choice because every other entry overestimates its gain;
+    // stale tops are re-scored a batch at a time across threads, kept for
+    // the whole loop as a round is often only microseconds of work
+    detail::PairCover cover(n_items);
+    detail::TaskPool pool(n_threads);
+    size_t batch_size = n_threads == 1 ? 1 : 8 * n_threads;
+    std::vector<Candidate> batch;
+    size_t round = 0;
+    while (!heap.empty() && (max_markers == 0 || round < max_markers))
+    {
+        Candidate top = heap.top();
+        if (top.round == round)
+        {
+            heap.pop();
+            const uint64_t* lo = planes.data() + (top.site * site_size);
+            cover.cover(lo, lo + n_words);
+            round++;
+            stream << sites[top.site] << '\t' << top.gain << '\t'
+                   << cover.uncovered() << '\n';
+            continue;
+        }
+        batch.clear();
+        while (!heap.empty() && batch.size() < batch_size
+               && heap.top().round != round)
+        {
+            batch.push_back(heap.top());
+            heap.pop();
+        }
+        pool.run(
+            batch.size(),
+            [&](size_t b)
+            {
+                const uint64_t* lo
+                    = planes.data() + (batch[b].site * site_size);
+                batch[b].gain = cover.gain(lo, lo + n_words);
+                batch[b].round = round;
+            });
+        for (const auto& candidate : batch)
+        {
+            if (candidate.gain > 0)
+            {
+                heap.push(candidate);
+            }
+        }
+    }
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+PairCover::PairCover(size_t n_items)
+    : n_items_(n_items),
+      n_words_(words_for(n_items)),
+      rows_(n_items * n_words_),
+      uncovered_(n_items * (n_items - 1) / 2)
+{
+    for (size_t i = 0; i < n_items_; ++i)
+    {
+        uint64_t* row = rows_.data() + (i * n_words_);
+        for (size_t j = 0; j < n_items_; ++j)
+        {
+            row[j / 64] |= j != i ? uint64_t{1} << (j % 64) : 0;
+        }
+    }
+}
+
+template <typename Fn>
+void PairCover::for_each_called(
+    const uint64_t* lo,
+    const uint64_t* hi,
+    Fn&& fn) const
+{
+    std::vector<uint64_t> classes(3 * n_words_);
+    uint64_t* ref = classes.data();
+    uint64_t* het = ref + n_words_;
+    uint64_t* alt = het + n_words_;
+    for (size_t w = 0; w < n_words_; ++w)
+    {
+        ref[w] = ~lo[w] & ~hi[w];
+        het[w] = lo[w] & ~hi[w];
+        alt[w] = hi[w] & ~lo[w];
+    }
+    // padding packs as 0/0, it is not a called item
+    if (n_items_ % 64 != 0)
+    {
+        ref[n_words_ - 1] &= (uint64_t{1} << (n_items_ % 64)) - 1;
+    }
+
+    std::vector<uint64_t> other(n_words_);
+    auto visit = [&](const uint64_t* members,
+                     const uint64_t* a,
+                     const uint64_t* b)
+    {
+        for (size_t w = 0; w < n_words_; ++w)
+        {
+            other[w] = a[w] | b[w];
+        }
+        for (size_t w = 0; w < n_words_; ++w)
+        {
+            for (uint64_t bits = members[w]; bits != 0; bits &= bits - 1)
+            {
+                fn((w * 64) + std::countr_zero(bits), other.data());
+            }
+        }
+    };
+    visit(ref, het, alt);
+    visit(het, ref, alt);
+    visit(alt, ref, het);
+}
+
+uint64_t PairCover::gain(const uint64_t* lo, const uint64_t* hi) const
+{
+    uint64_t twice = 0;
+    for_each_called(
+        lo,
+        hi,
+        [&](size_t i, const uint64_t* other)
+        {
+            const uint64_t* row = rows_.data() + (i * n_words_);
+            for (size_t w = 0; w < n_words_; ++w)
+            {
+                twice += std::popcount(row[w] & other[w]);
+            }
+        });
+    // every separated pair was seen from both of its items
+    return twice / 2;
+}
+
+void PairCover::cover(const uint64_t* lo, const uint64_t* hi)
+{
+    uint64_t twice = 0;
+    for_each_called(
+        lo,
+        hi,
+        [&](size_t i, const uint64_t* other)
+        {
+            uint64_t* row = rows_.data() + (i * n_words_);
+            for (size_t w = 0; w < n_words_; ++w)
+            {
+                twice += std::popcount(row[w] & other[w]);
+                row[w] &= ~other[w];
+            }
+        });
+    uncovered_ -= twice / 2;
+}
+
+}  // namespace detail
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace vcfbox
+{
+// Picks a small marker panel that tells apart every pair of parents
+// (`target` "parents") or of predicted hybrids ("hybrids") of the crosses
+// in a pairs file, by greedy set cover: each step takes the site that
+// separates the most pairs still unresolved, until no site separates any
+// or `max_markers` (0 for no cap) are chosen. Two items are separated by a
+// site where both are called and their genotypes differ. Writes the chosen
+// sites in selection order with the pairs each one resolved and the
+// number still unresolved after it.
+void select_markers(
+    const std::string& vcf_path,
+    const std::string& pairs_path,
+    const std::string& out_path,
+    const std::string& target,
+    size_t max_markers,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// The set of item pairs not yet separated, as a symmetric bit matrix with
+// one row per item. A site's separated pairs are the pairs across its
+// genotype classes (the outer products of its ref, het and alt masks), so
+// a candidate is stored as its lo/hi planes over the items, 2 bits per
+// item rather than one per pair, and its gain is one AND and popcount per
+// called item and word.
+class PairCover
+{
+   public:
+    explicit PairCover(size_t n_items);
+
+    uint64_t gain(const uint64_t* lo, const uint64_t* hi) const;
+    void cover(const uint64_t* lo, const uint64_t* hi);
+    uint64_t uncovered() const { return uncovered_; }
+
+   private:
+    // Calls fn(item, mask of the items in other classes) for every called
+    // item of the site.
+    template <typename Fn>
+    void for_each_called(const uint64_t* lo, const uint64_t* hi, Fn&& fn)
+        const;
+
+    size_t n_items_;
+    size_t n_words_;
+    std::vector<uint64_t> rows_;
+    uint64_t uncovered_;
+};
+
+}  // namespace detail
@@ -0,0 +1,50 @@
+#include "matrix.h"
+
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace detail
+{
+TilePairs::TilePairs(size_t n_samples, size_t tile)
+    : n_samples(n_samples), tile(tile), n_tiles((n_samples + tile - 1) / tile)
+{
+    for (size_t i = 0; i < n_tiles; ++i)
+    {
+        for (size_t j = i; j < n_tiles; ++j)
+        {
+            pairs.emplace_back(i, j);
+        }
+    }
+}
+
+void write_sample_ids(const std::string& path, bcf_hdr_t* header)
+{
+    std::ofstream stream(path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + path);
+    }
+    for (int i = 0; i < bcf_hdr_nsamples(header); ++i)
+    {
+        stream << header->samples[i] << '\n';
+    }
+}
+
+void write_sample_ids(
+    const std::string& path,
+    const std::vector<std::string>& names)
+{
+    std::ofstream stream(path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + path);
+    }
+    for (const auto& name : names)
+    {
+        stream << name << '\n';
+    }
+}
+
+}  // namespace detail
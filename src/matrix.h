@@ -0,0 +1,92 @@
+#pragma once
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+// The upper triangle (diagonal included) of an n x n pairwise matrix cut
+// into tile x tile blocks. Pairwise passes hand one tile pair to one task,
+// so tasks never share accumulators.
+struct TilePairs
+{
+    TilePairs(size_t n_samples, size_t tile);
+
+    // Position of tile pair (tile_i, tile_j), tile_i <= tile_j, in `pairs`.
+    size_t index(size_t tile_i, size_t tile_j) const
+    {
+        return (tile_i * n_tiles) - (tile_i * (tile_i + 1) / 2) + tile_j;
+    }
+
+    size_t n_samples;
+    size_t tile;
+    size_t n_tiles;
+    std::vector<std::pair<size_t, size_t>> pairs;
+};
+
+// One sample name per line, in matrix row order.
+void write_sample_ids(const std::string& path, bcf_hdr_t* header);
+void write_sample_ids(
+    const std::string& path,
+    const std::vector<std::string>& names);
+
+// Writes an n x n matrix produced by value(i, j), either as tab-separated
+// text or as raw row-major float32. Rows are built one at a time so the
+// caller can keep its own (e.g. triangular) storage.
+template <typename ValueFn>
+void write_square_matrix(
+    const std::string& path,
+    size_t n,
+    bool binary,
+    ValueFn&& value)
+{
+    std::ofstream stream(
+        path, binary ? std::ios::binary | std::ios::out : std::ios::out);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + path);
+    }
+    std::vector<float> row(n);
+    std::string line;
+    for (size_t i = 0; i < n; ++i)
+    {
+        for (size_t j = 0; j < n; ++j)
+        {
+            row[j] = static_cast<float>(value(i, j));
+        }
+        if (binary)
+        {
+            stream.write(
+                reinterpret_cast<const char*>(row.data()),
+                static_cast<std::streamsize>(n * sizeof(float)));
+            continue;
+        }
+        line.clear();
+        for (size_t j = 0; j < n; ++j)
+        {
+            std::format_to(
+                std::back_inserter(line),
+                "{}{:.6g}",
+                j == 0 ? "" : "\t",
+                row[j]);
+        }
+        line += '\n';
+        stream << line;
+    }
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to write output file: " + path);
+    }
+}
+
+}  // namespace detail
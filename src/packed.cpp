@@ -0,0 +1,140 @@
+#include "packed.h"
+
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace detail
+{
+void pack_site(
+    const int32_t* gt_arr,
+    int n_gt,
+    int n_samples,
+    uint64_t* lo,
+    uint64_t* hi)
+{
+    size_t n_words = words_for(n_samples);
+    std::fill_n(lo, n_words, 0);
+    std::fill_n(hi, n_words, 0);
+    int ploidy = n_gt / n_samples;
+    for (int i = 0; i < n_samples; ++i)
+    {
+        const int32_t* sample = gt_arr + static_cast<ptrdiff_t>(i) * ploidy;
+        GenotypeCode code = encode_gt(
+            sample[0], ploidy > 1 ? sample[1] : bcf_int32_vector_end);
+        uint64_t bit = uint64_t{1} << (i % 64);
+        lo[i / 64] |= (code & 1) != 0 ? bit : 0;
+        hi[i / 64] |= (code & 2) != 0 ? bit : 0;
+    }
+}
+
+SiteCounts count_site(
+    const uint64_t* lo,
+    const uint64_t* hi,
+    size_t n_samples)
+{
+    SiteCounts counts;
+    for (size_t w = 0; w < words_for(n_samples); ++w)
+    {
+        counts.het += std::popcount(lo[w] & ~hi[w]);
+        counts.hom_alt += std::popcount(hi[w] & ~lo[w]);
+        counts.missing += std::popcount(lo[w] & hi[w]);
+    }
+    counts.hom_ref = n_samples - counts.het - counts.hom_alt - counts.missing;
+    return counts;
+}
+
+SampleCounter::SampleCounter(size_t n_samples)
+    : n_samples_(n_samples),
+      n_words_(words_for(n_samples)),
+      planes_(n_words_ * kPlanes),
+      totals_(n_samples)
+{
+}
+
+void SampleCounter::add(const uint64_t* bits)
+{
+    for (size_t w = 0; w < n_words_; ++w)
+    {
+        uint64_t carry = bits[w];
+        uint64_t* plane = planes_.data() + w * kPlanes;
+        for (int p = 0; p < kPlanes && carry != 0; ++p)
+        {
+            uint64_t sum = plane[p] ^ carry;
+            carry &= plane[p];
+            plane[p] = sum;
+        }
+    }
+    if (++pending_ == kMaxPending)
+    {
+        flush();
+    }
+}
+
+const std::vector<uint64_t>& SampleCounter::totals()
+{
+    flush();
+    return totals_;
+}
+
+void SampleCounter::flush()
+{
+    if (pending_ == 0)
+    {
+        return;
+    }
+    for (size_t i = 0; i < n_samples_; ++i)
+    {
+        const uint64_t* plane = planes_.data() + (i / 64) * kPlanes;
+        uint64_t value = 0;
+        for (int p = 0; p < kPlanes; ++p)
+        {
+            value |= ((plane[p] >> (i % 64)) & 1) << p;
+        }
+        totals_[i] += value;
+    }
+    std::fill(planes_.begin(), planes_.end(), 0);
+    pending_ = 0;
+}
+
+SampleBlock::SampleBlock(size_t n_samples, size_t block_sites)
+    : n_samples_(n_samples),
+      block_sites_(block_sites),
+      n_words_(words_for(block_sites)),
+      data_(n_samples * 2 * n_words_)
+{
+    reset();
+}
+
+void SampleBlock::reset()
+{
+    std::fill(data_.begin(), data_.end(), ~uint64_t{0});
+    n_sites_ = 0;
+}
+
+void SampleBlock::add_site(const int32_t* gt_arr, int n_gt)
+{
+    size_t word = n_sites_ / 64;
+    uint64_t clear = ~(uint64_t{1} << (n_sites_ % 64));
+    int ploidy = n_gt / static_cast<int>(n_samples_);
+    for (size_t i = 0; i < n_samples_; ++i)
+    {
+        const int32_t* sample = gt_arr + i * ploidy;
+        GenotypeCode code = encode_gt(
+            sample[0], ploidy > 1 ? sample[1] : bcf_int32_vector_end);
+        uint64_t* row = data_.data() + i * 2 * n_words_;
+        if ((code & 1) == 0)
+        {
+            row[word] &= clear;
+        }
+        if ((code & 2) == 0)
+        {
+            row[n_words_ + word] &= clear;
+        }
+    }
+    n_sites_++;
+}
+
+}  // namespace detail
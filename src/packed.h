@@ -0,0 +1,147 @@
+#pragma once
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+// Biallelic diploid calls as 2-bit codes, stored as two bitplanes per site
+// (bit i of a plane belongs to sample i):
+//
+//   code   hi lo
+//   0/0     0  0
+//   0/1     0  1
+//   1/1     1  0
+//   ./.     1  1
+//
+// so every per-site count is a popcount of one AND over the planes, and
+// padding bits past the last sample read as 0/0 without special casing.
+enum GenotypeCode : uint8_t
+{
+    kHomRef = 0,
+    kHet = 1,
+    kHomAlt = 2,
+    kMissing = 3,
+};
+
+constexpr size_t words_for(size_t n_samples)
+{
+    return (n_samples + 63) / 64;
+}
+
+inline GenotypeCode encode_gt(int32_t gt0, int32_t gt1)
+{
+    // haploid calls are padded with vector_end and count as homozygous
+    if (gt1 == bcf_int32_vector_end)
+    {
+        gt1 = gt0;
+    }
+    if (bcf_gt_is_missing(gt0) || bcf_gt_is_missing(gt1)
+        || gt0 == bcf_int32_vector_end)
+    {
+        return kMissing;
+    }
+    int dosage = static_cast<int>(bcf_gt_allele(gt0) != 0)
+                 + static_cast<int>(bcf_gt_allele(gt1) != 0);
+    if (dosage == 1)
+    {
+        return kHet;
+    }
+    return dosage == 2 ? kHomAlt : kHomRef;
+}
+
+inline GenotypeCode code_at(const uint64_t* lo, const uint64_t* hi, size_t i)
+{
+    uint64_t bit = uint64_t{1} << (i % 64);
+    return static_cast<GenotypeCode>(
+        ((hi[i / 64] & bit) != 0 ? 2 : 0) | ((lo[i / 64] & bit) != 0 ? 1 : 0));
+}
+
+struct SiteCounts
+{
+    size_t hom_ref = 0;
+    size_t het = 0;
+    size_t hom_alt = 0;
+    size_t missing = 0;
+
+    size_t called() const { return hom_ref + het + hom_alt; }
+    size_t alt_alleles() const { return het + 2 * hom_alt; }
+};
+
+// Fills n_words of `lo`/`hi` from a bcf_get_genotypes() array, assuming the
+// record has already been restricted to two alleles.
+void pack_site(
+    const int32_t* gt_arr,
+    int n_gt,
+    int n_samples,
+    uint64_t* lo,
+    uint64_t* hi);
+
+SiteCounts count_site(
+    const uint64_t* lo,
+    const uint64_t* hi,
+    size_t n_samples);
+
+// Per-sample counts of set bits across many sites. Additions go into eight
+// bit-sliced counter planes (a ripple-carry adder per 64 samples), and are
+// only expanded to integers every 255 sites, so the hot path is a handful
+// of word-wide AND/XOR per site instead of one increment per sample.
+class SampleCounter
+{
+   public:
+    explicit SampleCounter(size_t n_samples = 0);
+
+    void add(const uint64_t* bits);
+    const std::vector<uint64_t>& totals();
+
+   private:
+    static constexpr int kPlanes = 8;
+    static constexpr int kMaxPending = (1 << kPlanes) - 1;
+
+    void flush();
+
+    size_t n_samples_;
+    size_t n_words_;
+    std::vector<uint64_t> planes_;
+    std::vector<uint64_t> totals_;
+    int pending_ = 0;
+};
+
+// A block of sites transposed to one row per sample, the layout pairwise
+// kernels want: row i is sample i's lo plane for the block followed by its
+// hi plane. Unused site slots stay coded as missing, so a partly filled
+// block needs no masking downstream.
+class SampleBlock
+{
+   public:
+    SampleBlock(size_t n_samples, size_t block_sites);
+
+    void reset();
+    void add_site(const int32_t* gt_arr, int n_gt);
+
+    bool full() const { return n_sites_ == block_sites_; }
+    size_t n_sites() const { return n_sites_; }
+    size_t n_samples() const { return n_samples_; }
+    size_t used_words() const { return words_for(n_sites_); }
+
+    const uint64_t* lo(size_t sample) const
+    {
+        return data_.data() + sample * 2 * n_words_;
+    }
+    const uint64_t* hi(size_t sample) const { return lo(sample) + n_words_; }
+
+   private:
+    size_t n_samples_;
+    size_t block_sites_;
+    size_t n_words_;
+    size_t n_sites_ = 0;
+    std::vector<uint64_t> data_;
+};
+
+}  // namespace detail
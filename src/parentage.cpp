@@ -0,0 +1,480 @@
+#include "parentage.h"
+
+#include <algorithm>
+#include <atomic>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <set>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "kernels.h"
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf.h"
+#include "vcf_raii.h"
+
+namespace
+{
+// 4096 sites per block keeps a sample row at 1 KiB, as in distance.
+constexpr size_t kBlockSites = 4096;
+
+struct PairScore
+{
+    size_t a = 0;
+    size_t b = 0;
+    detail::TrioCounts counts;
+    double score = 2.;  // above any real score, so "not found"
+};
+
+void append_rate(std::string& out, uint32_t num, uint32_t den)
+{
+    if (den == 0)
+    {
+        out += "\tNA";
+        return;
+    }
+    std::format_to(
+        std::back_inserter(out),
+        "\t{:.6g}",
+        static_cast<double>(num) / static_cast<double>(den));
+}
+
+}  // namespace
+
+namespace vcfbox
+{
+void verify_hybrids(
+    const std::string& vcf_path,
+    const std::string& trios_path,
+    const std::string& out_path,
+    size_t n_threads)
+{
+    detail::RegionReader probe(vcf_path);
+    auto trios = detail::parse_trios(trios_path, probe.header());
+    if (trios.empty())
+    {
+        throw std::runtime_error("No hybrids in: " + trios_path);
+    }
+    size_t n_samples = bcf_hdr_nsamples(probe.header());
+    size_t n_trios = trios.size();
+    auto regions = detail::split_regions(probe, n_threads * 8);
+    size_t n_workers = detail::worker_count(regions, n_threads);
+
+    // per-worker compared/discordant/opposite triples indexed by trio,
+    // summed once every shard is done
+    std::vector<std::vector<uint64_t>> totals(
+        n_workers, std::vector<uint64_t>(3 * n_trios));
+
+    std::atomic<size_t> processd_snp = 0;
+    auto counter = detail::create_counter("Verifying hybrids", processd_snp);
+    counter->show();
+    detail::for_each_region(
+        vcf_path,
+        regions,
+        n_threads,
+        [&](size_t worker, size_t, detail::RegionReader& reader)
+        {
+            detail::SampleBlock block(n_samples, kBlockSites);
+            BcfRec rec(bcf_init());
+            Genotypes gt;
+            auto& sums = totals[worker];
+            while (true)
+            {
+                block.reset();
+                while (!block.full())
+                {
+                    int n_gt
+                        = detail::next_biallelic_gt(reader, rec.get(), gt);
+                    if (n_gt == 0)
+                    {
+                        break;
+                    }
+                    block.add_site(gt.p_, n_gt);
+                }
+                if (block.n_sites() == 0)
+                {
+                    break;
+                }
+                processd_snp += block.n_sites();
+                size_t words = block.used_words();
+                for (size_t t = 0; t < n_trios; ++t)
+                {
+                    const auto& trio = trios[t];
+                    auto c = detail::trio_counts(
+                        block.lo(trio.hybrid_sample),
+                        block.hi(trio.hybrid_sample),
+                        block.lo(trio.female_sample),
+                        block.hi(trio.female_sample),
+                        block.lo(trio.male_sample),
+                        block.hi(trio.male_sample),
+                        words);
+                    sums[3 * t] += c.compared;
+                    sums[(3 * t) + 1] += c.discordant;
+                    sums[(3 * t) + 2] += c.opposite;
+                }
+            }
+        });
+    counter->done();
+
+    std::ofstream stream(out_path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + out_path);
+    }
+    stream << "hybrid\tfemale\tmale\tn_compared\tn_discordant\tdiscordance\t"
+              "n_opposite_hom\n";
+    std::string line;
+    for (size_t t = 0; t < n_trios; ++t)
+    {
+        uint64_t compared = 0;
+        uint64_t discordant = 0;
+        uint64_t opposite = 0;
+        for (const auto& sums : totals)
+        {
+            compared += sums[3 * t];
+            discordant += sums[(3 * t) + 1];
+            opposite += sums[(3 * t) + 2];
+        }
+        const auto& trio = trios[t];
+        line = std::format(
+            "{}\t{}\t{}\t{}\t{}\t",
+            trio.hybrid,
+            trio.female,
+            trio.male,
+            compared,
+            discordant);
+        if (compared == 0)
+        {
+            line += "NA";
+        }
+        else
+        {
+            std::format_to(
+                std::back_inserter(line),
+                "{:.6g}",
+                static_cast<double>(discordant)
+                    / static_cast<double>(compared));
+        }
+        std::format_to(std::back_inserter(line), "\t{}\n", opposite);
+        stream << line;
+    }
+}
+
+void find_parents(
+    const std::string& vcf_path,
+    const std::string& parents_path,
+    const std::string& hybrids_path,
+    const std::string& out_path,
+    size_t max_markers,
+    size_t n_candidates,
+    size_t n_threads)
+{
+    detail::RegionReader reader(vcf_path);
+    reader.seek(detail::Region{});
+    bcf_hdr_t* header = reader.header();
+    int n_samples = bcf_hdr_nsamples(header);
+
+    auto names = parse_sample_list(parents_path);
+    size_t n_parents = names.size();
+    if (n_parents < 2)
+    {
+        throw std::runtime_error(
+            "Parent search needs at least two parents: " + parents_path);
+    }
+    std::set<std::string> parents(names.begin(), names.end());
+    if (!hybrids_path.empty())
+    {
+        // a hybrid among the parents would be found as its own parent
+        std::string overlap;
+        for (const auto& name : parse_sample_list(hybrids_path))
+        {
+            if (parents.contains(name))
+            {
+                overlap += name + ", ";
+            }
+            names.push_back(name);
+        }
+        if (!overlap.empty())
+        {
+            throw std::runtime_error(
+                "Samples listed as both hybrids and parents: " + overlap
+                + "make sure the two lists do not overlap.");
+        }
+    }
+    else
+    {
+        for (int i = 0; i < n_samples; ++i)
+        {
+            if (!parents.contains(header->samples[i]))
+            {
+                names.emplace_back(header->samples[i]);
+            }
+        }
+    }
+    size_t n_hybrids = names.size() - n_parents;
+    if (n_hybrids == 0)
+    {
+        throw std::runtime_error("No hybrids to assign in: " + vcf_path);
+    }
+
+    // rows [0, n_parents) are the parents, the hybrids follow
+    detail::MarkerPanel panel(
+        detail::resolve_samples(header, names), max_markers);
+    BcfRec rec(bcf_init());
+    Genotypes gt;
+    size_t processd_snp = 0;
+    auto counter = detail::create_counter("Reading markers", processd_snp);
+    counter->show();
+    while (true)
+    {
+        int n_gt = detail::next_biallelic_gt(reader, rec.get(), gt);
+        if (n_gt == 0)
+        {
+            break;
+        }
+        processd_snp++;
+        panel.add_site(gt.p_, n_gt, n_samples);
+    }
+    counter->done();
+    panel.finish();
+    if (panel.n_markers() == 0)
+    {
+        throw std::runtime_error(
+            "No polymorphic biallelic sites in: " + vcf_path);
+    }
+
+    size_t words = panel.n_words();
+    detail::IbsKernel kernel = detail::ibs_kernel();
+    size_t n_keep = std::min(n_candidates, n_parents);
+    std::vector<std::pair<PairScore, PairScore>> results(n_hybrids);
+    detail::parallel_for(
+        n_hybrids,
+        n_threads,
+        [&](size_t h)
+        {
+            size_t row = n_parents + h;
+            // a true parent of an inbred cross is never the opposite
+            // homozygote of the hybrid, so rank single parents by how
+            // often they are, smoothed so little overlap ranks low
+            std::vector<std::pair<double, size_t>> screen(n_parents);
+            for (size_t p = 0; p < n_parents; ++p)
+            {
+                detail::IbsCounts c;
+                kernel(
+                    panel.lo(row),
+                    panel.hi(row),
+                    panel.lo(p),
+                    panel.hi(p),
+                    words,
+                    c);
+                screen[p] = {(c.ibs0 + 1.) / (c.valid + 2.), p};
+            }
+            std::partial_sort(
+                screen.begin(),
+                screen.begin() + static_cast<ptrdiff_t>(n_keep),
+                screen.end());
+            std::vector<size_t> candidates(n_keep);
+            for (size_t k = 0; k < n_keep; ++k)
+            {
+                candidates[k] = screen[k].second;
+            }
+            std::sort(candidates.begin(), candidates.end());
+
+            auto& [best, runner_up] = results[h];
+            for (size_t x = 0; x < n_keep; ++x)
+            {
+                for (size_t y = x + 1; y < n_keep; ++y)
+                {
+                    size_t a = candidates[x];
+                    size_t b = candidates[y];
+                    PairScore pair{
+                        a,
+                        b,
+                        detail::trio_counts(
+                            panel.lo(row),
+                            panel.hi(row),
+                            panel.lo(a),
+                            panel.hi(a),
+                            panel.lo(b),
+                            panel.hi(b),
+                            words)};
+                    pair.score = (pair.counts.discordant + 1.)
+                                 / (pair.counts.compared + 2.);
+                    if (pair.score < best.score)
+                    {
+                        runner_up = best;
+                        best = pair;
+                    }
+                    else if (pair.score < runner_up.score)
+                    {
+                        runner_up = pair;
+                    }
+                }
+            }
+        });
+
+    std::ofstream stream(out_path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + out_path);
+    }
+    stream << "hybrid\tparent1\tparent2\tn_compared\tn_discordant\t"
+              "discordance\trunner_up1\trunner_up2\trunner_up_discordance\n";
+    std::string line;
+    for (size_t h = 0; h < n_hybrids; ++h)
+    {
+        const auto& [best, runner_up] = results[h];
+        line = std::format(
+            "{}\t{}\t{}\t{}\t{}",
+            names[n_parents + h],
+            names[best.a],
+            names[best.b],
+            best.counts.compared,
+            best.counts.discordant);
+        append_rate(line, best.counts.discordant, best.counts.compared);
+        if (runner_up.score > 1.)
+        {
+            line += "\tNA\tNA\tNA";
+        }
+        else
+        {
+            std::format_to(
+                std::back_inserter(line),
+                "\t{}\t{}",
+                names[runner_up.a],
+                names[runner_up.b]);
+            append_rate(
+                line, runner_up.counts.discordant, runner_up.counts.compared);
+        }
+        stream << line << '\n';
+    }
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+std::vector<Trio> parse_trios(const std::string& path, bcf_hdr_t* header)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open hybrid trios file: " + path);
+    }
+    std::vector<Trio> trios;
+    std::vector<std::string> names;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream iss(line);
+        Trio trio;
+        if (!(iss >> trio.hybrid >> trio.female >> trio.male))
+        {
+            continue;
+        }
+        names.insert(names.end(), {trio.hybrid, trio.female, trio.male});
+        trios.push_back(std::move(trio));
+    }
+
+    auto samples = resolve_samples(header, names);
+    for (size_t t = 0; t < trios.size(); ++t)
+    {
+        trios[t].hybrid_sample = samples[3 * t];
+        trios[t].female_sample = samples[(3 * t) + 1];
+        trios[t].male_sample = samples[(3 * t) + 2];
+    }
+    return trios;
+}
+
+MarkerPanel::MarkerPanel(std::vector<int> samples, size_t max_markers)
+    : samples_(std::move(samples)),
+      max_markers_(max_markers),
+      site_words_(words_for(samples_.size()))
+{
+}
+
+void MarkerPanel::add_site(const int32_t* gt_arr, int n_gt, int n_samples)
+{
+    int ploidy = n_gt / n_samples;
+    size_t base = sites_.size();
+    sites_.resize(base + (2 * site_words_));
+    uint64_t* lo = sites_.data() + base;
+    uint64_t* hi = lo + site_words_;
+    // one bit per dosage seen, polymorphic once two are set
+    unsigned seen = 0;
+    for (size_t r = 0; r < samples_.size(); ++r)
+    {
+        const int32_t* sample = gt_arr + (samples_[r] * ploidy);
+        GenotypeCode code = encode_gt(
+            sample[0], ploidy > 1 ? sample[1] : bcf_int32_vector_end);
+        uint64_t bit = uint64_t{1} << (r % 64);
+        lo[r / 64] |= (code & 1) != 0 ? bit : 0;
+        hi[r / 64] |= (code & 2) != 0 ? bit : 0;
+        seen |= code != kMissing ? 1U << code : 0U;
+    }
+    if (std::popcount(seen) < 2 || offered_++ % stride_ != 0)
+    {
+        sites_.resize(base);
+        return;
+    }
+    n_markers_++;
+    if (n_markers_ <= max_markers_)
+    {
+        return;
+    }
+    size_t site_size = 2 * site_words_;
+    size_t kept = 0;
+    for (size_t s = 0; s < n_markers_; s += 2, ++kept)
+    {
+        std::copy_n(
+            sites_.begin() + static_cast<ptrdiff_t>(s * site_size),
+            site_size,
+            sites_.begin() + static_cast<ptrdiff_t>(kept * site_size));
+    }
+    n_markers_ = kept;
+    sites_.resize(kept * site_size);
+    stride_ *= 2;
+}
+
+void MarkerPanel::finish()
+{
+    size_t words = n_words();
+    // all ones is missing, which also covers the padding past n_markers_
+    rows_.assign(samples_.size() * 2 * words, ~uint64_t{0});
+    for (size_t s = 0; s < n_markers_; ++s)
+    {
+        const uint64_t* lo = sites_.data() + (s * 2 * site_words_);
+        const uint64_t* hi = lo + site_words_;
+        uint64_t clear = ~(uint64_t{1} << (s % 64));
+        for (size_t r = 0; r < samples_.size(); ++r)
+        {
+            uint64_t bit = uint64_t{1} << (r % 64);
+            uint64_t* row = rows_.data() + (r * 2 * words);
+            if ((lo[r / 64] & bit) == 0)
+            {
+                row[s / 64] &= clear;
+            }
+            if ((hi[r / 64] & bit) == 0)
+            {
+                row[words + (s / 64)] &= clear;
+            }
+        }
+    }
+    sites_.clear();
+    sites_.shrink_to_fit();
+}
+
+}  // namespace detail
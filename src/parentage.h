@@ -0,0 +1,96 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace vcfbox
+{
+// Checks every sequenced hybrid in a "hybrid female male" file against the
+// genotype its claimed inbred parents predict (the call combine would
+// write), from one pass over the biallelic sites of a VCF holding all
+// three. Writes per-hybrid compared, discordant and opposite-homozygote
+// site counts as TSV.
+void verify_hybrids(
+    const std::string& vcf_path,
+    const std::string& trios_path,
+    const std::string& out_path,
+    size_t n_threads);
+
+// Finds, for each sample in `hybrids_path` (every non-parent when empty,
+// and none of the parents otherwise), the pair of inbred lines from
+// `parents_path` that best explains it.
+// Genotypes are read once, at up to `max_markers` polymorphic sites spread
+// evenly over the file. Each hybrid first screens single parents by
+// opposite homozygotes, keeps the `n_candidates` closest, and only pairs
+// among those are scored on every marker. Writes the best and runner-up
+// pair per hybrid as TSV.
+void find_parents(
+    const std::string& vcf_path,
+    const std::string& parents_path,
+    const std::string& hybrids_path,
+    const std::string& out_path,
+    size_t max_markers,
+    size_t n_candidates,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+struct Trio
+{
+    std::string hybrid;
+    std::string female;
+    std::string male;
+    int hybrid_sample = -1;
+    int female_sample = -1;
+    int male_sample = -1;
+};
+
+// Reads "hybrid female male" lines and resolves them against `header`,
+// listing every name it does not contain in the error.
+std::vector<Trio> parse_trios(const std::string& path, bcf_hdr_t* header);
+
+// Genotypes of a fixed set of samples at up to `max_markers` sites. Sites
+// are offered in file order; polymorphic ones are kept at every
+// `stride`-th offer, and whenever the panel overflows every other kept
+// site is dropped and the stride doubles, so the markers stay evenly
+// spread without knowing the site count up front. Kept site-major while
+// reading and transposed by finish() to a row per sample in the layout of
+// SampleBlock, padding coded missing.
+class MarkerPanel
+{
+   public:
+    MarkerPanel(std::vector<int> samples, size_t max_markers);
+
+    void add_site(const int32_t* gt_arr, int n_gt, int n_samples);
+    void finish();
+
+    size_t n_markers() const { return n_markers_; }
+    size_t n_words() const { return words_for(n_markers_); }
+    const uint64_t* lo(size_t row) const
+    {
+        return rows_.data() + (row * 2 * n_words());
+    }
+    const uint64_t* hi(size_t row) const { return lo(row) + n_words(); }
+
+   private:
+    std::vector<int> samples_;
+    size_t max_markers_;
+    size_t site_words_;
+    size_t stride_ = 1;
+    size_t offered_ = 0;
+    size_t n_markers_ = 0;
+    std::vector<uint64_t> sites_;  // per site: lo plane, then hi plane
+    std::vector<uint64_t> rows_;
+};
+
+}  // namespace detail
@@ -0,0 +1,402 @@
+#include "pca.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <numeric>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "kernels.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace
+{
+constexpr size_t kBlockSites = 256;
+constexpr size_t kTile = detail::kPanelWidth;
+// a fixed seed keeps repeated runs on the same input identical
+constexpr uint64_t kSeed = 0x9e3779b97f4a7c15;
+
+// Two rounds of modified Gram-Schmidt over the columns of a row-major
+// n x width matrix. A column that vanishes (fewer sites than columns) is
+// left at zero rather than filled with noise.
+void orthonormalize(std::vector<double>& q, size_t n, size_t width)
+{
+    for (size_t c = 0; c < width; ++c)
+    {
+        for (int round = 0; round < 2; ++round)
+        {
+            for (size_t d = 0; d < c; ++d)
+            {
+                double dot = 0;
+                for (size_t i = 0; i < n; ++i)
+                {
+                    dot += q[(i * width) + d] * q[(i * width) + c];
+                }
+                for (size_t i = 0; i < n; ++i)
+                {
+                    q[(i * width) + c] -= dot * q[(i * width) + d];
+                }
+            }
+        }
+        double norm = 0;
+        for (size_t i = 0; i < n; ++i)
+        {
+            norm += q[(i * width) + c] * q[(i * width) + c];
+        }
+        norm = std::sqrt(norm);
+        for (size_t i = 0; i < n; ++i)
+        {
+            q[(i * width) + c] = norm > 1e-12 ? q[(i * width) + c] / norm : 0.;
+        }
+    }
+}
+
+// Cyclic Jacobi eigen decomposition of a small symmetric m x m matrix.
+// Eigenvalues come back in descending order, with eigenvector r in column
+// r of the row-major `vectors`.
+void symmetric_eigen(
+    std::vector<double> a,
+    size_t m,
+    std::vector<double>& values,
+    std::vector<double>& vectors)
+{
+    std::vector<double> v(m * m, 0.);
+    for (size_t i = 0; i < m; ++i)
+    {
+        v[(i * m) + i] = 1.;
+    }
+    for (int sweep = 0; sweep < 64; ++sweep)
+    {
+        double off = 0;
+        double diag = 0;
+        for (size_t p = 0; p < m; ++p)
+        {
+            diag += a[(p * m) + p] * a[(p * m) + p];
+            for (size_t q = p + 1; q < m; ++q)
+            {
+                off += a[(p * m) + q] * a[(p * m) + q];
+            }
+        }
+        if (off <= 1e-30 * diag)
+        {
+            break;
+        }
+        for (size_t p = 0; p < m; ++p)
+        {
+            for (size_t q = p + 1; q < m; ++q)
+            {
+                double apq = a[(p * m) + q];
+                if (apq == 0)
+                {
+                    continue;
+                }
+                double theta = (a[(q * m) + q] - a[(p * m) + p]) / (2 * apq);
+                double t = std::copysign(1., theta)
+                           / (std::abs(theta) + std::sqrt((theta * theta) + 1));
+                double c = 1 / std::sqrt((t * t) + 1);
+                double s = t * c;
+                for (size_t k = 0; k < m; ++k)
+                {
+                    double akp = a[(k * m) + p];
+                    double akq = a[(k * m) + q];
+                    a[(k * m) + p] = (c * akp) - (s * akq);
+                    a[(k * m) + q] = (s * akp) + (c * akq);
+                }
+                for (size_t k = 0; k < m; ++k)
+                {
+                    double apk = a[(p * m) + k];
+                    double aqk = a[(q * m) + k];
+                    a[(p * m) + k] = (c * apk) - (s * aqk);
+                    a[(q * m) + k] = (s * apk) + (c * aqk);
+                }
+                for (size_t k = 0; k < m; ++k)
+                {
+                    double vkp = v[(k * m) + p];
+                    double vkq = v[(k * m) + q];
+                    v[(k * m) + p] = (c * vkp) - (s * vkq);
+                    v[(k * m) + q] = (s * vkp) + (c * vkq);
+                }
+            }
+        }
+    }
+
+    std::vector<size_t> order(m);
+    std::iota(order.begin(), order.end(), 0);
+    std::sort(
+        order.begin(),
+        order.end(),
+        [&](size_t x, size_t y) { return a[(x * m) + x] > a[(y * m) + y]; });
+    values.resize(m);
+    vectors.resize(m * m);
+    for (size_t r = 0; r < m; ++r)
+    {
+        values[r] = a[(order[r] * m) + order[r]];
+        for (size_t k = 0; k < m; ++k)
+        {
+            vectors[(k * m) + r] = v[(k * m) + order[r]];
+        }
+    }
+}
+
+}  // namespace
+
+namespace vcfbox
+{
+void pca(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    size_t n_components,
+    size_t oversample,
+    size_t iterations,
+    size_t n_threads)
+{
+    detail::RegionReader probe(vcf_path);
+    bcf_hdr_t* header = probe.header();
+    size_t n_samples = bcf_hdr_nsamples(header);
+    if (n_components == 0 || n_components > n_samples)
+    {
+        throw std::runtime_error(
+            "Number of components must be between 1 and the sample count");
+    }
+    if (iterations == 0)
+    {
+        throw std::runtime_error("PCA needs at least one iteration");
+    }
+    size_t width = std::min(n_components + oversample, n_samples);
+
+    detail::SubspaceProduct product(n_samples, width);
+    std::vector<double>& q = product.basis();
+    std::mt19937_64 rng(kSeed);
+    std::normal_distribution<double> normal;
+    for (size_t i = 0; i < n_samples * width; ++i)
+    {
+        q[i] = normal(rng);
+    }
+    orthonormalize(q, n_samples, width);
+
+    detail::DosagePanels first(n_samples, kBlockSites);
+    detail::DosagePanels second(n_samples, kBlockSites);
+    std::vector<float> z(n_samples);
+    BcfRec rec(bcf_init());
+    Genotypes gt;
+    size_t n_sites = 0;
+    for (size_t pass = 0; pass < iterations; ++pass)
+    {
+        detail::RegionReader reader(vcf_path);
+        reader.seek(detail::Region{});
+        product.reset();
+        n_sites = 0;
+        size_t processd_snp = 0;
+        auto counter = detail::create_counter(
+            std::format("PCA pass {}/{}", pass + 1, iterations),
+            processd_snp);
+        counter->show();
+        detail::pipeline_blocks(
+            first,
+            second,
+            [&](detail::DosagePanels& block)
+            {
+                block.reset();
+                while (!block.full())
+                {
+                    int n_gt
+                        = detail::next_biallelic_gt(reader, rec.get(), gt);
+                    if (n_gt == 0)
+                    {
+                        break;
+                    }
+                    processd_snp++;
+                    double var = detail::center_dosages(
+                        gt.p_, n_gt, n_samples, z.data());
+                    if (var <= 0)
+                    {
+                        continue;
+                    }
+                    auto inv_sd = static_cast<float>(1 / std::sqrt(var));
+                    for (float& value : z)
+                    {
+                        value *= inv_sd;
+                    }
+                    block.add_site(z.data());
+                    n_sites++;
+                }
+                return block.n_sites() > 0;
+            },
+            [&](const detail::DosagePanels& block)
+            { product.add_block(block, n_threads); });
+        counter->done();
+        if (n_sites == 0)
+        {
+            throw std::runtime_error(
+                "No polymorphic biallelic sites in: " + vcf_path);
+        }
+        if (pass + 1 < iterations)
+        {
+            q = product.product();
+            orthonormalize(q, n_samples, width);
+        }
+    }
+
+    // Rayleigh-Ritz on the final basis: H = Q' X'X Q is width x width
+    const std::vector<double>& y = product.product();
+    std::vector<double> h(width * width, 0.);
+    for (size_t i = 0; i < n_samples; ++i)
+    {
+        for (size_t a = 0; a < width; ++a)
+        {
+            for (size_t b = 0; b < width; ++b)
+            {
+                h[(a * width) + b] += q[(i * width) + a] * y[(i * width) + b];
+            }
+        }
+    }
+    for (size_t a = 0; a < width; ++a)
+    {
+        for (size_t b = a + 1; b < width; ++b)
+        {
+            double mean = (h[(a * width) + b] + h[(b * width) + a]) / 2;
+            h[(a * width) + b] = mean;
+            h[(b * width) + a] = mean;
+        }
+    }
+    std::vector<double> values;
+    std::vector<double> vectors;
+    symmetric_eigen(h, width, values, vectors);
+
+    std::vector<double> pcs(n_samples * n_components, 0.);
+    for (size_t r = 0; r < n_components; ++r)
+    {
+        double largest = 0;
+        for (size_t i = 0; i < n_samples; ++i)
+        {
+            double value = 0;
+            for (size_t c = 0; c < width; ++c)
+            {
+                value += q[(i * width) + c] * vectors[(c * width) + r];
+            }
+            pcs[(i * n_components) + r] = value;
+            if (std::abs(value) > std::abs(largest))
+            {
+                largest = value;
+            }
+        }
+        // eigenvectors have no sign, pin it so reruns plot the same way
+        if (largest < 0)
+        {
+            for (size_t i = 0; i < n_samples; ++i)
+            {
+                pcs[(i * n_components) + r] *= -1;
+            }
+        }
+    }
+
+    std::string vec_path = out_prefix + ".eigenvec";
+    std::ofstream vec_stream(vec_path);
+    if (!vec_stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + vec_path);
+    }
+    std::string line = "sample";
+    for (size_t r = 0; r < n_components; ++r)
+    {
+        std::format_to(std::back_inserter(line), "\tPC{}", r + 1);
+    }
+    vec_stream << line << '\n';
+    for (size_t i = 0; i < n_samples; ++i)
+    {
+        line = header->samples[i];
+        for (size_t r = 0; r < n_components; ++r)
+        {
+            std::format_to(
+                std::back_inserter(line),
+                "\t{:.6g}",
+                pcs[(i * n_components) + r]);
+        }
+        vec_stream << line << '\n';
+    }
+
+    std::string val_path = out_prefix + ".eigenval";
+    std::ofstream val_stream(val_path);
+    if (!val_stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + val_path);
+    }
+    for (size_t r = 0; r < n_components; ++r)
+    {
+        val_stream << std::format(
+            "{:.6g}\n", values[r] / static_cast<double>(n_sites));
+    }
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+SubspaceProduct::SubspaceProduct(size_t n_samples, size_t width)
+    : n_tiles_((n_samples + kTile - 1) / kTile),
+      width_(width),
+      q_(n_tiles_ * kTile * width, 0.),
+      y_(n_tiles_ * kTile * width, 0.)
+{
+}
+
+void SubspaceProduct::reset()
+{
+    std::fill(y_.begin(), y_.end(), 0.);
+}
+
+void SubspaceProduct::add_block(const DosagePanels& block, size_t n_threads)
+{
+    size_t n_sites = block.n_sites();
+    size_t stride = n_sites * width_;
+    // T = X_block Q is a sum over every panel, so each chunk of panels
+    // projects into its own partial T before they are added up
+    size_t n_chunks = std::clamp<size_t>(n_threads, 1, n_tiles_);
+    t_.assign(n_chunks * stride, 0.);
+    parallel_for(
+        n_chunks,
+        n_threads,
+        [&](size_t chunk)
+        {
+            for (size_t tile = chunk; tile < n_tiles_; tile += n_chunks)
+            {
+                panel_project(
+                    block.panel(tile),
+                    n_sites,
+                    q_.data() + (tile * kTile * width_),
+                    width_,
+                    t_.data() + (chunk * stride));
+            }
+        });
+    for (size_t chunk = 1; chunk < n_chunks; ++chunk)
+    {
+        for (size_t k = 0; k < stride; ++k)
+        {
+            t_[k] += t_[(chunk * stride) + k];
+        }
+    }
+    // Y += X_block' T, panels own disjoint rows of Y
+    parallel_for(
+        n_tiles_,
+        n_threads,
+        [&](size_t tile)
+        {
+            panel_accumulate(
+                block.panel(tile),
+                n_sites,
+                t_.data(),
+                width_,
+                y_.data() + (tile * kTile * width_));
+        });
+}
+
+}  // namespace detail
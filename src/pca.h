@@ -0,0 +1,52 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "grm.h"
+
+namespace vcfbox
+{
+// Top `n_components` principal components of the standardised genotype
+// matrix by randomized subspace iteration (Halko et al. 2011). Every
+// iteration is one streaming pass that multiplies the current sample basis
+// by X'X, so memory is O(samples x (components + oversample)) however many
+// sites there are; the last pass also yields the Rayleigh-Ritz estimates.
+// Writes `<out_prefix>.eigenvec` (one row per sample) and
+// `<out_prefix>.eigenval` (eigenvalues of the GRM X'X / sites).
+void pca(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    size_t n_components,
+    size_t oversample,
+    size_t iterations,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// Y = X'X Q for a sample x width basis Q, accumulated one DosagePanels
+// block of standardised sites at a time. Both Q and Y are row-major with
+// rows padded to a whole number of panels, padding rows stay zero.
+class SubspaceProduct
+{
+   public:
+    SubspaceProduct(size_t n_samples, size_t width);
+
+    size_t width() const { return width_; }
+    std::vector<double>& basis() { return q_; }
+    const std::vector<double>& product() const { return y_; }
+
+    void reset();
+    void add_block(const DosagePanels& block, size_t n_threads);
+
+   private:
+    size_t n_tiles_;
+    size_t width_;
+    std::vector<double> q_;
+    std::vector<double> y_;
+    std::vector<double> t_;
+};
+
+}  // namespace detail
@@ -0,0 +1,64 @@
+#pragma once
+#include <array>
+#include <cmath>
+#include <cstdint>
+
+namespace detail
+{
+// Philox4x32-10 (Salmon et al. 2011), a counter-based generator: the
+// output is a pure function of (key, counter), so any draw of any stream
+// is computed directly, with no state to carry between threads or to
+// replay to reach it. Callers spend the 128-bit counter on the ids of
+// what a draw is for plus a draw index.
+class Philox
+{
+   public:
+    using Block = std::array<uint32_t, 4>;
+
+    explicit constexpr Philox(uint64_t key)
+        : key_{static_cast<uint32_t>(key), static_cast<uint32_t>(key >> 32)}
+    {
+    }
+
+    constexpr Block operator()(Block ctr) const
+    {
+        uint32_t k0 = key_[0];
+        uint32_t k1 = key_[1];
+        for (int round = 0; round < 10; ++round)
+        {
+            uint64_t p0 = uint64_t{kMul0} * ctr[0];
+            uint64_t p1 = uint64_t{kMul1} * ctr[2];
+            ctr = {
+                static_cast<uint32_t>(p1 >> 32) ^ ctr[1] ^ k0,
+                static_cast<uint32_t>(p1),
+                static_cast<uint32_t>(p0 >> 32) ^ ctr[3] ^ k1,
+                static_cast<uint32_t>(p0)};
+            k0 += kWeyl0;
+            k1 += kWeyl1;
+        }
+        return ctr;
+    }
+
+    // A uniform double in [0, 1) from the first 53 bits of a block.
+    static constexpr double uniform(const Block& block)
+    {
+        uint64_t bits = (uint64_t{block[0]} << 21) | (block[1] >> 11);
+        return static_cast<double>(bits) * 0x1p-53;
+    }
+
+    // An exponential draw with mean 1, from the same bits.
+    static double exponential(const Block& block)
+    {
+        return -std::log1p(-uniform(block));
+    }
+
+   private:
+    static constexpr uint32_t kMul0 = 0xD2511F53;
+    static constexpr uint32_t kMul1 = 0xCD9E8D57;
+    static constexpr uint32_t kWeyl0 = 0x9E3779B9;
+    static constexpr uint32_t kWeyl1 = 0xBB67AE85;
+
+    std::array<uint32_t, 2> key_;
+};
+
+}  // namespace detail
@@ -0,0 +1,357 @@
+#include "popgen.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <limits>
+#include <map>
+#include <mutex>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace
+{
+using WindowKey = std::pair<int, hts_pos_t>;  // rid, window index
+
+void append_value(std::string& out, double value)
+{
+    if (std::isnan(value))
+    {
+        out += "\tNA";
+    }
+    else
+    {
+        std::format_to(std::back_inserter(out), "\t{:.6g}", value);
+    }
+}
+
+}  // namespace
+
+namespace vcfbox
+{
+void popgen(
+    const std::string& vcf_path,
+    const std::string& groups_path,
+    const std::string& out_path,
+    hts_pos_t window,
+    hts_pos_t step,
+    size_t n_threads)
+{
+    if (window <= 0 || step <= 0 || step > window)
+    {
+        throw std::runtime_error(
+            "Window must be positive and the step in [1, window]");
+    }
+    detail::RegionReader probe(vcf_path);
+    auto groups = detail::parse_sample_groups(groups_path, probe.header());
+    size_t n_groups = groups.names.size();
+    size_t n_samples = bcf_hdr_nsamples(probe.header());
+    auto regions = detail::split_regions(probe, n_threads * 8);
+    size_t n_workers = detail::worker_count(regions, n_threads);
+
+    // windows cut by a shard boundary show up in two workers' maps and are
+    // added back together below
+    std::vector<std::map<WindowKey, detail::WindowSums>> partial(n_workers);
+    std::vector<std::string> contig_names;
+    std::mutex names_mutex;
+
+    std::atomic<size_t> processd_snp = 0;
+    auto counter
+        = detail::create_counter("Computing diversity", processd_snp);
+    counter->show();
+    detail::for_each_region(
+        vcf_path,
+        regions,
+        n_threads,
+        [&](size_t worker, size_t, detail::RegionReader& reader)
+        {
+            auto& windows = partial[worker];
+            BcfRec rec(bcf_init());
+            Genotypes gt;
+            std::vector<size_t> alt(n_groups);
+            std::vector<size_t> called(n_groups);
+            detail::WindowSums site(n_groups);
+            site.n_sites = 1;
+            size_t local = 0;
+            while (true)
+            {
+                int n_gt = detail::next_biallelic_gt(reader, rec.get(), gt);
+                if (n_gt == 0)
+                {
+                    break;
+                }
+                if (++local == 4096)
+                {
+                    processd_snp += local;
+                    local = 0;
+                }
+
+                std::fill(alt.begin(), alt.end(), 0);
+                std::fill(called.begin(), called.end(), 0);
+                int ploidy = n_gt / static_cast<int>(n_samples);
+                for (size_t i = 0; i < n_samples; ++i)
+                {
+                    int g = groups.group_of[i];
+                    if (g < 0)
+                    {
+                        continue;
+                    }
+                    for (int k = 0; k < ploidy; ++k)
+                    {
+                        int32_t allele = gt.p_[(i * ploidy) + k];
+                        if (allele == bcf_int32_vector_end
+                            || bcf_gt_is_missing(allele))
+                        {
+                            continue;
+                        }
+                        called[g]++;
+                        alt[g] += bcf_gt_allele(allele) != 0 ? 1 : 0;
+                    }
+                }
+
+                std::fill(site.pi.begin(), site.pi.end(), 0.);
+                std::fill(
+                    site.fst_numerator.begin(), site.fst_numerator.end(), 0.);
+                std::fill(
+                    site.fst_denominator.begin(),
+                    site.fst_denominator.end(),
+                    0.);
+                for (size_t g = 0; g < n_groups; ++g)
+                {
+                    auto n = static_cast<double>(called[g]);
+                    auto a = static_cast<double>(alt[g]);
+                    if (called[g] >= 2)
+                    {
+                        site.pi[g] = 2 * a * (n - a) / (n * (n - 1));
+                    }
+                    site.segregating[g] = alt[g] > 0 && alt[g] < called[g];
+                }
+                size_t pair = 0;
+                for (size_t g1 = 0; g1 < n_groups; ++g1)
+                {
+                    for (size_t g2 = g1 + 1; g2 < n_groups; ++g2, ++pair)
+                    {
+                        if (called[g1] < 2 || called[g2] < 2)
+                        {
+                            continue;
+                        }
+                        auto n1 = static_cast<double>(called[g1]);
+                        auto n2 = static_cast<double>(called[g2]);
+                        double p1 = static_cast<double>(alt[g1]) / n1;
+                        double p2 = static_cast<double>(alt[g2]) / n2;
+                        site.fst_numerator[pair]
+                            = ((p1 - p2) * (p1 - p2))
+                              - (p1 * (1 - p1) / (n1 - 1))
+                              - (p2 * (1 - p2) / (n2 - 1));
+                        site.fst_denominator[pair]
+                            = (p1 * (1 - p2)) + (p2 * (1 - p1));
+                    }
+                }
+
+                // windows [k * step, k * step + window) holding this site
+                hts_pos_t pos = rec->pos;
+                hts_pos_t last = pos / step;
+                hts_pos_t first
+                    = pos < window ? 0 : ((pos - window) / step) + 1;
+                for (hts_pos_t k = first; k <= last; ++k)
+                {
+                    auto [it, inserted] = windows.try_emplace(
+                        WindowKey{rec->rid, k}, n_groups);
+                    it->second += site;
+                }
+            }
+            processd_snp += local;
+
+            bcf_hdr_t* header = reader.header();
+            std::lock_guard lock(names_mutex);
+            int n_seq = header->n[BCF_DT_CTG];
+            for (int rid = static_cast<int>(contig_names.size()); rid < n_seq;
+                 ++rid)
+            {
+                contig_names.emplace_back(bcf_hdr_id2name(header, rid));
+            }
+        });
+    counter->done();
+
+    std::map<WindowKey, detail::WindowSums> windows;
+    for (auto& worker_windows : partial)
+    {
+        for (auto& [key, sums] : worker_windows)
+        {
+            auto [it, inserted] = windows.try_emplace(key, n_groups);
+            it->second += sums;
+        }
+    }
+
+    std::ofstream stream(out_path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + out_path);
+    }
+    std::string line = "chrom\tstart\tend\tn_sites";
+    for (const auto& name : groups.names)
+    {
+        line += std::format("\tpi_{0}\ttajima_d_{0}", name);
+    }
+    for (size_t g1 = 0; g1 < n_groups; ++g1)
+    {
+        for (size_t g2 = g1 + 1; g2 < n_groups; ++g2)
+        {
+            line += std::format(
+                "\tfst_{}_{}", groups.names[g1], groups.names[g2]);
+        }
+    }
+    stream << line << '\n';
+
+    auto window_bp = static_cast<double>(window);
+    for (const auto& [key, sums] : windows)
+    {
+        hts_pos_t start = key.second * step;
+        line = std::format(
+            "{}\t{}\t{}\t{}",
+            contig_names[key.first],
+            start + 1,
+            start + window,
+            sums.n_sites);
+        for (size_t g = 0; g < n_groups; ++g)
+        {
+            append_value(line, sums.pi[g] / window_bp);
+            append_value(
+                line,
+                detail::tajima_d(
+                    sums.pi[g], sums.segregating[g], 2 * groups.sizes[g]));
+        }
+        for (size_t pair = 0; pair < sums.fst_numerator.size(); ++pair)
+        {
+            append_value(
+                line,
+                sums.fst_denominator[pair] > 0
+                    ? sums.fst_numerator[pair] / sums.fst_denominator[pair]
+                    : std::numeric_limits<double>::quiet_NaN());
+        }
+        stream << line << '\n';
+    }
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+SampleGroups parse_sample_groups(const std::string& path, bcf_hdr_t* header)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open sample groups file: " + path);
+    }
+    SampleGroups groups;
+    groups.group_of.assign(bcf_hdr_nsamples(header), -1);
+    std::unordered_map<std::string, int> group_idx;
+    std::vector<std::string> samples;
+    std::vector<std::string> sample_groups;
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream iss(line);
+        std::string sample;
+        std::string group;
+        if (!(iss >> sample >> group))
+        {
+            continue;
+        }
+        samples.push_back(std::move(sample));
+        sample_groups.push_back(std::move(group));
+    }
+
+    auto indices = resolve_samples(header, samples);
+    for (size_t s = 0; s < samples.size(); ++s)
+    {
+        int idx = indices[s];
+        const std::string& group = sample_groups[s];
+        auto [it, inserted] = group_idx.try_emplace(
+            group, static_cast<int>(groups.names.size()));
+        if (inserted)
+        {
+            groups.names.push_back(group);
+            groups.sizes.push_back(0);
+        }
+        if (groups.group_of[idx] < 0)
+        {
+            groups.sizes[it->second]++;
+        }
+        groups.group_of[idx] = it->second;
+    }
+    if (groups.names.empty())
+    {
+        throw std::runtime_error("No sample groups in: " + path);
+    }
+    return groups;
+}
+
+WindowSums::WindowSums(size_t n_groups)
+    : pi(n_groups, 0.),
+      segregating(n_groups, 0),
+      fst_numerator(n_groups * (n_groups - 1) / 2),
+      fst_denominator(fst_numerator.size())
+{
+}
+
+WindowSums& WindowSums::operator+=(const WindowSums& other)
+{
+    n_sites += other.n_sites;
+    for (size_t g = 0; g < pi.size(); ++g)
+    {
+        pi[g] += other.pi[g];
+        segregating[g] += other.segregating[g];
+    }
+    for (size_t p = 0; p < fst_numerator.size(); ++p)
+    {
+        fst_numerator[p] += other.fst_numerator[p];
+        fst_denominator[p] += other.fst_denominator[p];
+    }
+    return *this;
+}
+
+// Tajima (1989). Callers pass n as twice the group size, sites with
+// missing calls are not corrected for.
+double tajima_d(double pi, size_t segregating, size_t n)
+{
+    if (segregating == 0 || n < 4)
+    {
+        return std::numeric_limits<double>::quiet_NaN();
+    }
+    double a1 = 0;
+    double a2 = 0;
+    for (size_t i = 1; i < n; ++i)
+    {
+        a1 += 1. / static_cast<double>(i);
+        a2 += 1. / static_cast<double>(i * i);
+    }
+    auto nd = static_cast<double>(n);
+    double b1 = (nd + 1) / (3 * (nd - 1));
+    double b2 = 2 * ((nd * nd) + nd + 3) / (9 * nd * (nd - 1));
+    double c1 = b1 - (1 / a1);
+    double c2 = b2 - ((nd + 2) / (a1 * nd)) + (a2 / (a1 * a1));
+    double e1 = c1 / a1;
+    double e2 = c2 / ((a1 * a1) + a2);
+    auto s = static_cast<double>(segregating);
+    return (pi - (s / a1)) / std::sqrt((e1 * s) + (e2 * s * (s - 1)));
+}
+
+}  // namespace detail
@@ -0,0 +1,60 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace vcfbox
+{
+// Windowed nucleotide diversity and Tajima's D per group, and Hudson Fst
+// (Bhatia et al. 2013, ratio of averages) per pair of groups, from one pass
+// over biallelic sites. Groups come from a "sample group" file; samples it
+// does not list are ignored. Windows are `window` bp long and start every
+// `step` bp. Writes one TSV row per window with at least one site.
+void popgen(
+    const std::string& vcf_path,
+    const std::string& groups_path,
+    const std::string& out_path,
+    hts_pos_t window,
+    hts_pos_t step,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// Group membership as a flat per-sample array, the layout the per-site
+// allele counting loop wants.
+struct SampleGroups
+{
+    std::vector<std::string> names;
+    std::vector<int> group_of;  // per sample, -1 when not in any group
+    std::vector<size_t> sizes;
+};
+
+SampleGroups parse_sample_groups(const std::string& path, bcf_hdr_t* header);
+
+// Additive per-window sums, so a window split across shards is merged by
+// adding its pieces.
+struct WindowSums
+{
+    explicit WindowSums(size_t n_groups = 0);
+
+    size_t n_sites = 0;
+    std::vector<double> pi;             // per group, sum of site diversity
+    std::vector<size_t> segregating;    // per group
+    std::vector<double> fst_numerator;  // per group pair
+    std::vector<double> fst_denominator;
+
+    WindowSums& operator+=(const WindowSums& other);
+};
+
+// Tajima's D from summed pairwise diversity and segregating sites for a
+// sample of `n` sequences, NaN when undefined.
+double tajima_d(double pi, size_t segregating, size_t n);
+
+}  // namespace detail
@@ -0,0 +1,348 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+#include <deque>
+#include <format>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <vector>
+
+#if defined(__linux__)
+#include <linux/perf_event.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace
+{
+std::mutex registry_mutex;
+// a deque so counters handed out keep their address as threads register
+std::deque<detail::StageCounters> registry;
+std::vector<std::unique_ptr<detail::PerfGroup>> perf_groups;
+// events opened by any thread, and why the first refused one was refused
+unsigned perf_opened = 0;
+std::string perf_error;
+
+constexpr std::array<const char*, detail::kPerfEvents> kEventNames
+    = {"cycles", "instructions", "LLC misses", "branch misses"};
+
+#if defined(__linux__)
+int open_event(size_t event, int group_fd)
+{
+    perf_event_attr attr{};
+    attr.size = sizeof(attr);
+    switch (event)
+    {
+        case 0:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_CPU_CYCLES;
+            break;
+        case 1:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_INSTRUCTIONS;
+            break;
+        case 2:
+            attr.type = PERF_TYPE_HW_CACHE;
+            attr.config = PERF_COUNT_HW_CACHE_LL
+                          | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                          | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16);
+            break;
+        default:
+            attr.type = PERF_TYPE_HARDWARE;
+            attr.config = PERF_COUNT_HW_BRANCH_MISSES;
+            break;
+    }
+    attr.disabled = group_fd < 0 ? 1 : 0;
+    // user space only, which perf_event_paranoid 2 still allows
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    attr.read_format = PERF_FORMAT_GROUP;
+    return static_cast<int>(
+        syscall(SYS_perf_event_open, &attr, 0, -1, group_fd, 0));
+}
+#endif
+
+struct Row
+{
+    uint64_t ticks = 0;
+    uint64_t calls = 0;
+    detail::PerfValues events{};
+};
+
+}  // namespace
+
+namespace detail
+{
+const char* stage_name(Stage stage)
+{
+    switch (stage)
+    {
+        case Stage::kRead:
+            return "read";
+        case Stage::kUnpack:
+            return "bcf_unpack";
+        case Stage::kGetGenotypes:
+            return "bcf_get_genotypes";
+        case Stage::kConcatGt:
+            return "concat_gt";
+        case Stage::kCopyRecInfo:
+            return "copy_rec_info";
+        case Stage::kUpdateGenotypes:
+            return "bcf_update_genotypes";
+        case Stage::kWrite:
+            return "bcf_write";
+    }
+    return "unknown";
+}
+
+StageCounters* register_stage_counters()
+{
+    std::lock_guard lock(registry_mutex);
+    return &registry.emplace_back();
+}
+
+PerfGroup* register_perf_group()
+{
+    // opened outside the lock, which the constructor takes itself
+    auto group = std::make_unique<PerfGroup>();
+    std::lock_guard lock(registry_mutex);
+    return perf_groups.emplace_back(std::move(group)).get();
+}
+
+PerfGroup::PerfGroup()
+{
+    fds_.fill(-1);
+    slot_.fill(-1);
+    unsigned opened = 0;
+    std::string error;
+#if defined(__linux__)
+    for (size_t e = 0; e < kPerfEvents; ++e)
+    {
+        int fd = open_event(e, leader_);
+        if (fd < 0)
+        {
+            if (error.empty())
+            {
+                error = std::format("{}: {}", kEventNames[e], strerror(errno));
+            }
+            continue;
+        }
+        if (leader_ < 0)
+        {
+            leader_ = fd;
+        }
+        fds_[e] = fd;
+        slot_[e] = n_open_++;
+        opened |= 1U << e;
+    }
+    if (leader_ >= 0)
+    {
+        ioctl(leader_, PERF_EVENT_IOC_RESET, PERF_IOC_FLAG_GROUP);
+        ioctl(leader_, PERF_EVENT_IOC_ENABLE, PERF_IOC_FLAG_GROUP);
+    }
+#else
+    error = "perf events need Linux";
+#endif
+    std::lock_guard lock(registry_mutex);
+    perf_opened |= opened;
+    if (perf_error.empty())
+    {
+        perf_error = error;
+    }
+}
+
+PerfGroup::~PerfGroup()
+{
+#if defined(__linux__)
+    for (int fd : fds_)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+    }
+#endif
+}
+
+void PerfGroup::read(PerfValues& values) const
+{
+    values.fill(0);
+#if defined(__linux__)
+    if (leader_ < 0)
+    {
+        return;
+    }
+    // PERF_FORMAT_GROUP: the number of events, then one value per event
+    std::array<uint64_t, kPerfEvents + 1> buffer{};
+    if (::read(leader_, buffer.data(), sizeof(buffer)) <= 0)
+    {
+        return;
+    }
+    for (size_t e = 0; e < kPerfEvents; ++e)
+    {
+        if (slot_[e] >= 0)
+        {
+            values[e] = buffer[1 + slot_[e]];
+        }
+    }
+#endif
+}
+
+StageProfile::StageProfile(ProfileMode mode) : mode_(mode)
+{
+    {
+        std::lock_guard lock(registry_mutex);
+        for (auto& counters : registry)
+        {
+            counters = StageCounters{};
+        }
+    }
+    start_ = std::chrono::steady_clock::now();
+    start_tsc_ = read_tsc();
+}
+
+void StageProfile::report(std::ostream& out) const
+{
+    uint64_t ticks = read_tsc() - start_tsc_;
+    std::chrono::duration<double> wall
+        = std::chrono::steady_clock::now() - start_;
+    double seconds_per_tick
+        = ticks > 0 ? wall.count() / static_cast<double>(ticks) : 0.;
+    bool counters = mode_ == ProfileMode::kCounters;
+
+    std::lock_guard lock(registry_mutex);
+    std::array<Row, kStageCount> total;
+    std::vector<std::array<Row, kStageCount>> threads;
+    for (const auto& thread : registry)
+    {
+        std::array<Row, kStageCount> rows;
+        uint64_t calls = 0;
+        for (size_t s = 0; s < kStageCount; ++s)
+        {
+            rows[s] = {thread.ticks[s], thread.calls[s], thread.events[s]};
+            total[s].ticks += thread.ticks[s];
+            total[s].calls += thread.calls[s];
+            for (size_t e = 0; e < kPerfEvents; ++e)
+            {
+                total[s].events[e] += thread.events[s][e];
+            }
+            calls += thread.calls[s];
+        }
+        if (calls > 0)
+        {
+            threads.push_back(rows);
+        }
+    }
+
+    auto share = [&](double seconds)
+    { return wall.count() > 0 ? 100. * seconds / wall.count() : 0.; };
+    // per call, NA for events no thread could open
+    auto per_call = [&](const Row& row, size_t e)
+    {
+        if ((perf_opened & (1U << e)) == 0 || row.calls == 0)
+        {
+            return std::format("{:>10}", "NA");
+        }
+        return std::format(
+            "{:>10.1f}",
+            static_cast<double>(row.events[e])
+                / static_cast<double>(row.calls));
+    };
+    auto ipc = [&](const Row& row)
+    {
+        if ((perf_opened & 3U) != 3U || row.events[0] == 0)
+        {
+            return std::format("{:>7}", "NA");
+        }
+        return std::format(
+            "{:>7.2f}",
+            static_cast<double>(row.events[1])
+                / static_cast<double>(row.events[0]));
+    };
+    auto write_table = [&](const std::array<Row, kStageCount>& rows)
+    {
+        std::string header = std::format(
+            "{:<22}{:>12}{:>12}{:>12}{:>8}",
+            "stage",
+            "calls",
+            "seconds",
+            "ns/call",
+            "%");
+        if (counters)
+        {
+            header += std::format(
+                "{:>10}{:>7}{:>10}{:>10}",
+                "cyc/call",
+                "IPC",
+                "llc/call",
+                "br/call");
+        }
+        out << header << '\n';
+        double staged = 0;
+        for (size_t s = 0; s < kStageCount; ++s)
+        {
+            const Row& row = rows[s];
+            double seconds = static_cast<double>(row.ticks) * seconds_per_tick;
+            staged += seconds;
+            double ns_call
+                = row.calls > 0
+                      ? 1e9 * seconds / static_cast<double>(row.calls)
+                      : 0.;
+            std::string line = std::format(
+                "{:<22}{:>12}{:>12.3f}{:>12.1f}{:>8.1f}",
+                stage_name(static_cast<Stage>(s)),
+                row.calls,
+                seconds,
+                ns_call,
+                share(seconds));
+            if (counters)
+            {
+                line += per_call(row, 0) + ipc(row) + per_call(row, 2)
+                        + per_call(row, 3);
+            }
+            out << line << '\n';
+        }
+        return staged;
+    };
+
+    double staged = write_table(total);
+    double other = std::max(0., wall.count() - staged);
+    out << std::format(
+        "{:<22}{:>12}{:>12.3f}{:>12}{:>8.1f}\n",
+        "other",
+        "",
+        other,
+        "",
+        share(other));
+    out << std::format(
+        "{:<22}{:>12}{:>12.3f}{:>12}{:>8.1f}\n",
+        "wall",
+        "",
+        wall.count(),
+        "",
+        100.);
+    if (!counters)
+    {
+        return;
+    }
+    if (perf_opened != (1U << kPerfEvents) - 1)
+    {
+        out << "Some hardware counters are unavailable (" << perf_error
+            << "), check /proc/sys/kernel/perf_event_paranoid.\n";
+    }
+    if (threads.size() > 1)
+    {
+        for (size_t t = 0; t < threads.size(); ++t)
+        {
+            out << "\nthread " << t << '\n';
+            write_table(threads[t]);
+        }
+    }
+}
+
+}  // namespace detail
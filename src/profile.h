@@ -0,0 +1,206 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <ostream>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#endif
+
+namespace detail
+{
+// The stages of the combine record loop `--profile` splits time into.
+enum class Stage : uint8_t
+{
+    kRead,  // bcf_read: BGZF decompression and record parsing
+    kUnpack,
+    kGetGenotypes,
+    kConcatGt,
+    kCopyRecInfo,
+    kUpdateGenotypes,
+    kWrite,
+};
+inline constexpr size_t kStageCount = 7;
+
+const char* stage_name(Stage stage);
+
+enum class ProfileMode : uint8_t
+{
+    kOff,
+    kStages,    // TSC time per stage
+    kCounters,  // and hardware counters per stage
+};
+
+// Cycles, instructions, LLC misses and branch misses, in that order.
+inline constexpr size_t kPerfEvents = 4;
+using PerfValues = std::array<uint64_t, kPerfEvents>;
+
+// Time stamp counter on x86-64, the steady clock in ns elsewhere.
+inline uint64_t read_tsc()
+{
+#if defined(__x86_64__)
+    return __rdtsc();
+#else
+    return std::chrono::steady_clock::now().time_since_epoch().count();
+#endif
+}
+
+// One thread's totals. Every thread adds to its own copy, so a timed stage
+// takes no lock and shares no cache line; StageProfile sums the copies.
+struct StageCounters
+{
+    std::array<uint64_t, kStageCount> ticks{};
+    std::array<uint64_t, kStageCount> calls{};
+    std::array<PerfValues, kStageCount> events{};
+};
+
+StageCounters* register_stage_counters();
+
+inline thread_local StageCounters* tls_stage_counters = nullptr;
+
+inline StageCounters& thread_stage_counters()
+{
+    if (tls_stage_counters == nullptr)
+    {
+        tls_stage_counters = register_stage_counters();
+    }
+    return *tls_stage_counters;
+}
+
+// The calling thread's hardware counters, one perf_event_open group
+// counting user-space events of this thread only. Events the kernel
+// refuses (perf_event_paranoid, no PMU in a VM, non-Linux) read as zero
+// and are shown as NA, so a run never fails for lack of them.
+class PerfGroup
+{
+   public:
+    PerfGroup();
+    ~PerfGroup();
+    PerfGroup(const PerfGroup&) = delete;
+    PerfGroup& operator=(const PerfGroup&) = delete;
+
+    // Current running totals, one read() of the whole group.
+    void read(PerfValues& values) const;
+
+   private:
+    int leader_ = -1;
+    std::array<int, kPerfEvents> fds_{};
+    // position of each opened event in the group's read() layout
+    std::array<int, kPerfEvents> slot_{};
+    int n_open_ = 0;
+};
+
+PerfGroup* register_perf_group();
+
+inline thread_local PerfGroup* tls_perf_group = nullptr;
+
+inline const PerfGroup& thread_perf_group()
+{
+    if (tls_perf_group == nullptr)
+    {
+        tls_perf_group = register_perf_group();
+    }
+    return *tls_perf_group;
+}
+
+// Timing policies for code templated on whether it is profiled. A Scope
+// times the stage it is constructed with until it is destroyed; the
+// NoProfile one is empty, so a loop instantiated with it compiles to the
+// same code as an untimed one.
+struct NoProfile
+{
+    struct Scope
+    {
+        explicit Scope(Stage /*stage*/) {}
+    };
+};
+
+struct TscProfile
+{
+    class Scope
+    {
+       public:
+        explicit Scope(Stage stage) : stage_(stage), start_(read_tsc()) {}
+        ~Scope()
+        {
+            auto& counters = thread_stage_counters();
+            auto i = static_cast<size_t>(stage_);
+            counters.ticks[i] += read_tsc() - start_;
+            counters.calls[i]++;
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        Stage stage_;
+        uint64_t start_;
+    };
+};
+
+// TscProfile plus the thread's hardware counters, read around each stage.
+// Each read is a syscall, so this is for finding out why a stage is slow,
+// not how long it takes; compare times with TscProfile.
+struct PerfProfile
+{
+    class Scope
+    {
+       public:
+        explicit Scope(Stage stage) : stage_(stage)
+        {
+            thread_perf_group().read(start_events_);
+            start_ = read_tsc();
+        }
+        ~Scope()
+        {
+            uint64_t end = read_tsc();
+            PerfValues now;
+            thread_perf_group().read(now);
+            auto& counters = thread_stage_counters();
+            auto i = static_cast<size_t>(stage_);
+            counters.ticks[i] += end - start_;
+            counters.calls[i]++;
+            for (size_t e = 0; e < kPerfEvents; ++e)
+            {
+                counters.events[i][e] += now[e] - start_events_[e];
+            }
+        }
+        Scope(const Scope&) = delete;
+        Scope& operator=(const Scope&) = delete;
+
+       private:
+        Stage stage_;
+        PerfValues start_events_;
+        uint64_t start_;
+    };
+};
+
+template <typename Profile, typename Fn>
+decltype(auto) timed(Stage stage, Fn&& fn)
+{
+    typename Profile::Scope scope(stage);
+    return fn();
+}
+
+// Zeroes every thread's counters when constructed and, at report(), turns
+// the ticks since then into seconds by calibrating the TSC against the
+// steady clock over the same interval.
+class StageProfile
+{
+   public:
+    explicit StageProfile(ProfileMode mode);
+
+    // A table of calls, seconds, ns per call and share of the wall time
+    // per stage; time outside every stage is listed as "other". With
+    // counters, per-call cycles, IPC, LLC and branch misses follow, for all
+    // threads and then for each thread on its own.
+    void report(std::ostream& out) const;
+
+   private:
+    ProfileMode mode_;
+    uint64_t start_tsc_;
+    std::chrono::steady_clock::time_point start_;
+};
+
+}  // namespace detail
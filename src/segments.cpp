@@ -0,0 +1,280 @@
+#include "segments.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf.h"
+#include "vcf_raii.h"
+
+namespace
+{
+constexpr const char* kStateNames[] = {"recurrent", "het", "donor"};
+
+}  // namespace
+
+namespace vcfbox
+{
+void segments(
+    const std::string& vcf_path,
+    const std::string& donor,
+    const std::string& recurrent,
+    const std::string& samples_path,
+    const std::string& out_path,
+    const detail::SegmentOptions& options,
+    size_t n_threads)
+{
+    if (options.recomb_rate <= 0 || options.error_rate <= 0
+        || options.error_rate >= 1)
+    {
+        throw std::runtime_error(
+            "Recombination rate must be positive and the error rate in "
+            "(0, 1)");
+    }
+    detail::RegionReader probe(vcf_path);
+    bcf_hdr_t* header = probe.header();
+    int n_total = bcf_hdr_nsamples(header);
+    int donor_idx = detail::sample_index(header, donor);
+    int recurrent_idx = detail::sample_index(header, recurrent);
+    if (donor_idx == recurrent_idx)
+    {
+        throw std::runtime_error("Donor and recurrent parent are the same");
+    }
+
+    std::vector<int> samples;
+    if (!samples_path.empty())
+    {
+        samples = detail::resolve_samples(
+            header, parse_sample_list(samples_path));
+    }
+    else
+    {
+        for (int i = 0; i < n_total; ++i)
+        {
+            if (i != donor_idx && i != recurrent_idx)
+            {
+                samples.push_back(i);
+            }
+        }
+    }
+    if (samples.empty())
+    {
+        throw std::runtime_error("No progeny to segment in: " + vcf_path);
+    }
+    size_t n_samples = samples.size();
+
+    std::ofstream stream(out_path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + out_path);
+    }
+    stream << "#chrom\tstart\tend\tsample\tstate\tn_sites\n";
+    detail::OrderedWriter writer(stream);
+    auto regions = detail::contig_regions(probe);
+
+    std::atomic<size_t> processd_snp = 0;
+    auto counter = detail::create_counter("Calling segments", processd_snp);
+    counter->show();
+    detail::for_each_region(
+        vcf_path,
+        regions,
+        n_threads,
+        [&](size_t, size_t shard, detail::RegionReader& reader)
+        {
+            bcf_hdr_t* shard_header = reader.header();
+            detail::SegmentHmm hmm(n_samples, options);
+            std::vector<uint8_t> obs(n_samples);
+            std::vector<detail::Segment> found;
+            std::string chunk;
+            BcfRec rec(bcf_init());
+            Genotypes gt;
+            int rid = -1;
+
+            auto flush = [&]()
+            {
+                if (hmm.n_sites() == 0)
+                {
+                    return;
+                }
+                found.clear();
+                hmm.decode(found);
+                const char* chrom = bcf_hdr_id2name(shard_header, rid);
+                for (const auto& seg : found)
+                {
+                    std::format_to(
+                        std::back_inserter(chunk),
+                        "{}\t{}\t{}\t{}\t{}\t{}\n",
+                        chrom,
+                        seg.start,
+                        seg.end,
+                        shard_header->samples[samples[seg.sample]],
+                        kStateNames[seg.state],
+                        seg.n_sites);
+                }
+                writer.write(shard, chunk);
+            };
+
+            size_t local = 0;
+            while (true)
+            {
+                int n_gt = detail::next_biallelic_gt(reader, rec.get(), gt);
+                if (n_gt == 0)
+                {
+                    break;
+                }
+                if (++local == 4096)
+                {
+                    processd_snp += local;
+                    local = 0;
+                }
+                // an unindexed input is read as one region, a path never
+                // spans a contig boundary
+                if (rec->rid != rid)
+                {
+                    flush();
+                    rid = rec->rid;
+                }
+
+                int ploidy = n_gt / n_total;
+                auto code = [&](int sample)
+                {
+                    const int32_t* call = gt.p_ + (sample * ploidy);
+                    return detail::encode_gt(
+                        call[0], ploidy > 1 ? call[1] : bcf_int32_vector_end);
+                };
+                // only sites where the parents are opposite homozygotes
+                // tell the origin of a progeny call
+                auto d = code(donor_idx);
+                auto r = code(recurrent_idx);
+                bool informative
+                    = (d == detail::kHomRef && r == detail::kHomAlt)
+                      || (d == detail::kHomAlt && r == detail::kHomRef);
+                if (!informative)
+                {
+                    continue;
+                }
+                // hom-ref and hom-alt trade places when the donor carries
+                // the reference allele
+                bool swap = d == detail::kHomRef;
+                for (size_t i = 0; i < n_samples; ++i)
+                {
+                    auto c = static_cast<uint8_t>(code(samples[i]));
+                    obs[i] = swap && c != detail::kHet && c != detail::kMissing
+                                 ? 2 - c
+                                 : c;
+                }
+                hmm.add_site(rec->pos, obs.data());
+            }
+            processd_snp += local;
+            flush();
+            writer.finish(shard);
+        },
+        &writer);
+    counter->done();
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+SegmentHmm::SegmentHmm(size_t n_samples, const SegmentOptions& options)
+    : n_samples_(n_samples),
+      morgans_per_bp_(options.recomb_rate * 1e-8),
+      score_(3 * n_samples)
+{
+    step_.log_match = static_cast<float>(std::log1p(-options.error_rate));
+    step_.log_mismatch = static_cast<float>(std::log(options.error_rate / 2));
+}
+
+void SegmentHmm::add_site(hts_pos_t pos, const uint8_t* obs)
+{
+    if (pos_.empty())
+    {
+        // flat prior: every state enters the first site on equal terms
+        std::fill(score_.begin(), score_.end(), 0.F);
+        step_.log_stay = 0.F;
+        step_.log_switch = 0.F;
+    }
+    else
+    {
+        // Haldane map distance to the previous site, split evenly between
+        // the two states a path can switch to
+        auto bp = static_cast<double>(pos - pos_.back());
+        double p = 0.5 * -std::expm1(-2 * morgans_per_bp_ * bp);
+        p = std::clamp(p, 1e-12, 0.5);
+        step_.log_stay = static_cast<float>(std::log1p(-p));
+        step_.log_switch = static_cast<float>(std::log(p / 2));
+    }
+    size_t base = back_.size();
+    back_.resize(base + n_samples_);
+    viterbi_step(score_.data(), obs, step_, back_.data() + base, n_samples_);
+    pos_.push_back(pos);
+}
+
+void SegmentHmm::decode(std::vector<Segment>& out)
+{
+    size_t n_sites = pos_.size();
+    size_t first_out = out.size();
+    // all samples are traced back together, a site's back pointers are
+    // read as one contiguous row
+    std::vector<uint8_t> state(n_samples_);
+    std::vector<size_t> run_last(n_samples_, n_sites - 1);
+    for (size_t i = 0; i < n_samples_; ++i)
+    {
+        float r = score_[i];
+        float h = score_[n_samples_ + i];
+        float d = score_[(2 * n_samples_) + i];
+        state[i] = r >= h && r >= d ? 0 : (h >= d ? 1 : 2);
+    }
+    auto close_run = [&](size_t i, size_t first)
+    {
+        out.push_back(
+            {i,
+             state[i],
+             pos_[first],
+             pos_[run_last[i]] + 1,
+             run_last[i] - first + 1});
+    };
+    for (size_t k = n_sites - 1; k > 0; --k)
+    {
+        const uint8_t* back = back_.data() + (k * n_samples_);
+        for (size_t i = 0; i < n_samples_; ++i)
+        {
+            auto prev = static_cast<uint8_t>((back[i] >> (2 * state[i])) & 3);
+            if (prev != state[i])
+            {
+                close_run(i, k);
+                run_last[i] = k - 1;
+                state[i] = prev;
+            }
+        }
+    }
+    for (size_t i = 0; i < n_samples_; ++i)
+    {
+        close_run(i, 0);
+    }
+    std::sort(
+        out.begin() + static_cast<std::ptrdiff_t>(first_out),
+        out.end(),
+        [](const Segment& a, const Segment& b)
+        {
+            return a.sample != b.sample ? a.sample < b.sample
+                                        : a.start < b.start;
+        });
+
+    back_.clear();
+    pos_.clear();
+}
+
+}  // namespace detail
@@ -0,0 +1,83 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "kernels.h"
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+struct SegmentOptions
+{
+    double recomb_rate = 1.;   // cM per Mb, sets the chance of a switch
+    double error_rate = 0.01;  // chance a call contradicts its state
+};
+
+}  // namespace detail
+
+namespace vcfbox
+{
+// Calls parental-origin segments (recurrent, het or donor) along every
+// contig for the progeny of a backcross or RIL population, by Viterbi
+// decoding of a three-state HMM over the sites where the two parents are
+// called opposite homozygotes. Progeny are `samples_path` (every sample
+// but the parents when empty). Contigs are decoded in parallel. Writes a
+// BED with one row per segment, from its first to its last informative
+// site.
+void segments(
+    const std::string& vcf_path,
+    const std::string& donor,
+    const std::string& recurrent,
+    const std::string& samples_path,
+    const std::string& out_path,
+    const detail::SegmentOptions& options,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// One run of a sample's decoded path, as 0-based positions of the sites it
+// spans (end past the last one).
+struct Segment
+{
+    size_t sample;
+    int state;  // 0 recurrent, 1 het, 2 donor
+    hts_pos_t start;
+    hts_pos_t end;
+    size_t n_sites;
+};
+
+// Viterbi decoding of one contig for many samples at once. The forward
+// pass keeps one float score per sample and state and one byte of back
+// pointers per sample and site, so a contig costs n_samples bytes per
+// informative site until it is decoded.
+class SegmentHmm
+{
+   public:
+    SegmentHmm(size_t n_samples, const SegmentOptions& options);
+
+    // `obs` holds, per sample, the state its call matches or 3 if missing.
+    void add_site(hts_pos_t pos, const uint8_t* obs);
+    size_t n_sites() const { return pos_.size(); }
+
+    // Appends every sample's segments, by sample then position, and starts
+    // over for the next contig.
+    void decode(std::vector<Segment>& out);
+
+   private:
+    size_t n_samples_;
+    double morgans_per_bp_;
+    HmmStep step_;
+    std::vector<float> score_;
+    std::vector<uint8_t> back_;
+    std::vector<hts_pos_t> pos_;
+};
+
+}  // namespace detail
@@ -0,0 +1,375 @@
+#include "shard.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <functional>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "vcf_raii.h"
+
+namespace detail
+{
+namespace
+{
+// Below this a shard costs more in index seeks than it saves in balance.
+constexpr hts_pos_t kMinShardLength = 1'000'000;
+
+hts_pos_t contig_length(bcf_hdr_t* header, int rid)
+{
+    bcf_hrec_t* hrec = bcf_hdr_id2hrec(header, BCF_DT_CTG, 0, rid);
+    if (hrec == nullptr)
+    {
+        return 0;
+    }
+    int key = bcf_hrec_find_key(hrec, "length");
+    if (key < 0)
+    {
+        return 0;
+    }
+    return std::strtoll(hrec->vals[key], nullptr, 10);
+}
+
+}  // namespace
+
+RegionReader::RegionReader(const std::string& vcf_path, int hts_threads)
+    : file_(bcf_open(vcf_path.c_str(), "r"))
+{
+    if (!file_)
+    {
+        throw std::runtime_error("Could not open VCF file: " + vcf_path);
+    }
+    if (hts_threads > 0)
+    {
+        hts_set_threads(file_.get(), hts_threads);
+    }
+    header_.reset(bcf_hdr_read(file_.get()));
+    if (!header_)
+    {
+        throw std::runtime_error("Could not read VCF header from: " + vcf_path);
+    }
+
+    if (hts_get_format(file_.get())->format == bcf)
+    {
+        idx_.reset(
+            bcf_index_load3(vcf_path.c_str(), nullptr, HTS_IDX_SILENT_FAIL));
+    }
+    else if (hts_get_format(file_.get())->compression == bgzf)
+    {
+        tbx_.reset(
+            tbx_index_load3(vcf_path.c_str(), nullptr, HTS_IDX_SILENT_FAIL));
+    }
+}
+
+void RegionReader::seek(const Region& region)
+{
+    region_ = region;
+    itr_.reset();
+    sequential_ = region.rid < 0;
+    if (sequential_)
+    {
+        if (consumed_)
+        {
+            throw std::runtime_error(
+                "Sequential region can only be read once per reader");
+        }
+        consumed_ = true;
+        return;
+    }
+
+    if (idx_)
+    {
+        itr_.reset(
+            bcf_itr_queryi(idx_.get(), region.rid, region.beg, region.end));
+    }
+    else if (tbx_)
+    {
+        int tid = tbx_name2id(
+            tbx_.get(), bcf_hdr_id2name(header_.get(), region.rid));
+        if (tid >= 0)
+        {
+            itr_.reset(
+                tbx_itr_queryi(tbx_.get(), tid, region.beg, region.end));
+        }
+    }
+    else
+    {
+        throw std::runtime_error("Region queries require an indexed VCF/BCF");
+    }
+    // a null iterator simply means the contig has no records
+}
+
+bool RegionReader::next(bcf1_t* rec)
+{
+    while (true)
+    {
+        int ret = 0;
+        if (sequential_)
+        {
+            ret = bcf_read(file_.get(), header_.get(), rec);
+        }
+        else if (!itr_)
+        {
+            return false;
+        }
+        else if (tbx_)
+        {
+            ret = tbx_itr_next(file_.get(), tbx_.get(), itr_.get(), &line_.s_);
+            if (ret >= 0)
+            {
+                ret = vcf_parse(&line_.s_, header_.get(), rec) == 0 ? 0 : -2;
+            }
+        }
+        else
+        {
+            ret = bcf_itr_next(file_.get(), itr_.get(), rec);
+        }
+
+        if (ret < -1)
+        {
+            throw std::runtime_error("Failed to read VCF record");
+        }
+        if (ret < 0)
+        {
+            return false;
+        }
+        if (sequential_ || rec->pos >= region_.beg)
+        {
+            return true;
+        }
+    }
+}
+
+std::vector<Region> split_regions(const RegionReader& reader, size_t n_shards)
+{
+    if (!reader.indexed())
+    {
+        return {Region{}};
+    }
+
+    bcf_hdr_t* header = reader.header();
+    int n_contigs = header->n[BCF_DT_CTG];
+    std::vector<hts_pos_t> lengths(n_contigs);
+    hts_pos_t total = 0;
+    for (int rid = 0; rid < n_contigs; ++rid)
+    {
+        lengths[rid] = contig_length(header, rid);
+        total += lengths[rid];
+    }
+    hts_pos_t chunk = std::max(
+        kMinShardLength,
+        total / static_cast<hts_pos_t>(std::max<size_t>(n_shards, 1)));
+
+    std::vector<Region> regions;
+    for (int rid = 0; rid < n_contigs; ++rid)
+    {
+        if (lengths[rid] <= 0)
+        {
+            regions.push_back({rid, 0, HTS_POS_MAX});
+            continue;
+        }
+        for (hts_pos_t beg = 0; beg < lengths[rid]; beg += chunk)
+        {
+            // the last piece stays open-ended, records past the declared
+            // contig length still need a home
+            hts_pos_t end
+                = beg + chunk >= lengths[rid] ? HTS_POS_MAX : beg + chunk;
+            regions.push_back({rid, beg, end});
+        }
+    }
+    if (regions.empty())
+    {
+        return {Region{}};
+    }
+    return regions;
+}
+
+std::vector<Region> contig_regions(const RegionReader& reader)
+{
+    if (!reader.indexed())
+    {
+        return {Region{}};
+    }
+    std::vector<Region> regions;
+    for (int rid = 0; rid < reader.header()->n[BCF_DT_CTG]; ++rid)
+    {
+        regions.push_back({rid, 0, HTS_POS_MAX});
+    }
+    if (regions.empty())
+    {
+        return {Region{}};
+    }
+    return regions;
+}
+
+size_t worker_count(const std::vector<Region>& regions, size_t n_threads)
+{
+    return std::clamp<size_t>(
+        n_threads, 1, std::max<size_t>(regions.size(), 1));
+}
+
+int next_biallelic_gt(RegionReader& reader, bcf1_t* rec, Genotypes& gt)
+{
+    while (reader.next(rec))
+    {
+        bcf_unpack(rec, BCF_UN_STR);
+        if (rec->n_allele > 2)
+        {
+            continue;
+        }
+        int n_gt = bcf_get_genotypes(reader.header(), rec, &gt.p_, &gt.n_);
+        if (n_gt > 0)
+        {
+            return n_gt;
+        }
+    }
+    return 0;
+}
+
+void OrderedWriter::write(size_t shard, std::string& chunk)
+{
+    std::unique_lock lock(mutex_);
+    caught_up_.wait(
+        lock,
+        [&]()
+        {
+            return aborted_ || shard == head_
+                   || pending_bytes_ < kMaxPending;
+        });
+    if (aborted_)
+    {
+        chunk.clear();
+        return;
+    }
+    if (shard == head_)
+    {
+        out_ << chunk;
+    }
+    else
+    {
+        pending_[shard] += chunk;
+        pending_bytes_ += chunk.size();
+    }
+    chunk.clear();
+}
+
+void OrderedWriter::finish(size_t shard)
+{
+    std::lock_guard lock(mutex_);
+    finished_.insert(shard);
+    size_t head = head_;
+    while (finished_.erase(head_) != 0)
+    {
+        ++head_;
+        auto it = pending_.find(head_);
+        if (it != pending_.end())
+        {
+            out_ << it->second;
+            pending_bytes_ -= it->second.size();
+            pending_.erase(it);
+        }
+    }
+    if (head_ != head)
+    {
+        caught_up_.notify_all();
+    }
+}
+
+void OrderedWriter::abort()
+{
+    {
+        std::lock_guard lock(mutex_);
+        aborted_ = true;
+        pending_.clear();
+        pending_bytes_ = 0;
+    }
+    caught_up_.notify_all();
+}
+
+TaskPool::TaskPool(size_t n_threads)
+{
+    for (size_t i = 1; i < n_threads; ++i)
+    {
+        threads_.emplace_back([this]() { work(); });
+    }
+}
+
+TaskPool::~TaskPool()
+{
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    start_.notify_all();
+    threads_.clear();
+}
+
+void TaskPool::run(size_t n_tasks, const std::function<void(size_t)>& fn)
+{
+    {
+        std::lock_guard lock(mutex_);
+        fn_ = &fn;
+        n_tasks_ = n_tasks;
+        next_task_ = 0;
+        busy_ = threads_.size();
+        round_++;
+    }
+    start_.notify_all();
+    drain();
+
+    std::unique_lock lock(mutex_);
+    done_.wait(lock, [&]() { return busy_ == 0; });
+    fn_ = nullptr;
+    if (error_)
+    {
+        std::rethrow_exception(std::exchange(error_, nullptr));
+    }
+}
+
+void TaskPool::work()
+{
+    size_t seen = 0;
+    std::unique_lock lock(mutex_);
+    while (true)
+    {
+        start_.wait(lock, [&]() { return stop_ || round_ != seen; });
+        if (stop_)
+        {
+            return;
+        }
+        seen = round_;
+        lock.unlock();
+        drain();
+        lock.lock();
+        if (--busy_ == 0)
+        {
+            done_.notify_one();
+        }
+    }
+}
+
+void TaskPool::drain()
+{
+    try
+    {
+        for (size_t task = next_task_++; task < n_tasks_;
+             task = next_task_++)
+        {
+            (*fn_)(task);
+        }
+    }
+    catch (...)
+    {
+        std::lock_guard lock(mutex_);
+        if (!error_)
+        {
+            error_ = std::current_exception();
+        }
+        next_task_ = n_tasks_;
+    }
+}
+
+}  // namespace detail
@@ -0,0 +1,299 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <exception>
+#include <functional>
+#include <map>
+#include <mutex>
+#include <ostream>
+#include <set>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "vcf_raii.h"
+
+namespace detail
+{
+// A 0-based, half-open interval [beg, end) on contig `rid`. A region with
+// rid < 0 means "the whole file, read sequentially", which is what we fall
+// back to when the input has no index.
+struct Region
+{
+    int rid = -1;
+    hts_pos_t beg = 0;
+    hts_pos_t end = HTS_POS_MAX;
+};
+
+// One open handle on a VCF/BCF plus its index. Every worker thread owns its
+// own reader, htslib file handles must not be shared between threads.
+class RegionReader
+{
+   public:
+    explicit RegionReader(const std::string& vcf_path, int hts_threads = 0);
+
+    bcf_hdr_t* header() const { return header_.get(); }
+    bool indexed() const { return idx_ != nullptr || tbx_ != nullptr; }
+    const Region& region() const { return region_; }
+
+    void seek(const Region& region);
+
+    // Only records whose start lies inside the region are returned, so a
+    // record overlapping a shard boundary is seen exactly once.
+    bool next(bcf1_t* rec);
+
+   private:
+    HtsFile file_;
+    BcfHdr header_;
+    HtsIdx idx_;
+    Tbx tbx_;
+    HtsItr itr_;
+    KString line_;
+    Region region_;
+    bool sequential_ = true;
+    bool consumed_ = false;
+};
+
+// Cuts every contig into pieces of roughly equal length so that about
+// `n_shards` regions cover the genome. Unindexed inputs get one region.
+std::vector<Region> split_regions(
+    const RegionReader& reader,
+    size_t n_shards);
+
+// Regions at contig granularity, for passes that need whole chromosomes.
+std::vector<Region> contig_regions(const RegionReader& reader);
+
+size_t worker_count(const std::vector<Region>& regions, size_t n_threads);
+
+// Advances to the next biallelic record that carries genotypes, the same
+// filter combine and convert apply, and decodes its GT array into `gt`.
+// Returns the GT array length, or 0 once the region is exhausted.
+int next_biallelic_gt(RegionReader& reader, bcf1_t* rec, Genotypes& gt);
+
+// Serialises text produced by concurrent shards in shard order. Chunks of
+// the oldest unfinished shard go straight to the stream, later shards are
+// held back until everything before them is finished. Once kMaxPending
+// bytes are held back, a worker writing ahead waits for the oldest shard
+// to catch up, so memory stays bounded however far ahead workers get. The
+// oldest shard itself never waits, so while no shard fails some worker
+// always makes progress; a failed shard never finishes, and abort() then
+// releases the workers waiting behind it.
+class OrderedWriter
+{
+   public:
+    explicit OrderedWriter(std::ostream& out) : out_(out) {}
+
+    // Takes the contents of `chunk` and leaves it empty for reuse.
+    void write(size_t shard, std::string& chunk);
+    void finish(size_t shard);
+
+    // Wakes every waiting worker and drops whatever is written from then
+    // on, the output of a failed run being of no use.
+    void abort();
+
+   private:
+    static constexpr size_t kMaxPending = size_t{64} << 20;
+
+    std::ostream& out_;
+    std::mutex mutex_;
+    std::condition_variable caught_up_;
+    size_t head_ = 0;
+    std::map<size_t, std::string> pending_;
+    size_t pending_bytes_ = 0;
+    std::set<size_t> finished_;
+    bool aborted_ = false;
+};
+
+// Runs fn(worker, shard, reader) for every region on a pool of threads.
+// `worker` is in [0, worker_count()) and indexes per-thread accumulators,
+// `shard` indexes `regions`. The first exception thrown by any worker is
+// rethrown once all threads have stopped; it also aborts `writer`, when
+// the shards write through one, so no worker is left waiting on it.
+template <typename Fn>
+void for_each_region(
+    const std::string& vcf_path,
+    const std::vector<Region>& regions,
+    size_t n_threads,
+    Fn&& fn,
+    OrderedWriter* writer = nullptr)
+{
+    size_t n_workers = worker_count(regions, n_threads);
+    // a single sequential region cannot be split, hand the spare threads to
+    // htslib for BGZF decompression instead
+    int hts_threads = (regions.size() == 1 && regions[0].rid < 0)
+                          ? static_cast<int>(n_threads) - 1
+                          : 0;
+
+    std::atomic<size_t> next_shard = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&](size_t worker_id)
+    {
+        try
+        {
+            RegionReader reader(vcf_path, hts_threads);
+            for (size_t shard = next_shard++; shard < regions.size();
+                 shard = next_shard++)
+            {
+                reader.seek(regions[shard]);
+                fn(worker_id, shard, reader);
+            }
+        }
+        catch (...)
+        {
+            {
+                std::lock_guard lock(error_mutex);
+                if (!error)
+                {
+                    error = std::current_exception();
+                }
+                next_shard = regions.size();
+            }
+            if (writer != nullptr)
+            {
+                writer->abort();
+            }
+        }
+    };
+
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(n_workers - 1);
+        for (size_t i = 1; i < n_workers; ++i)
+        {
+            pool.emplace_back(worker, i);
+        }
+        worker(0);
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+// Runs fn(task) for task in [0, n_tasks) on a pool of threads, with the
+// same error propagation as for_each_region.
+template <typename Fn>
+void parallel_for(size_t n_tasks, size_t n_threads, Fn&& fn)
+{
+    size_t n_workers
+        = std::clamp<size_t>(n_threads, 1, std::max<size_t>(n_tasks, 1));
+    std::atomic<size_t> next_task = 0;
+    std::exception_ptr error;
+    std::mutex error_mutex;
+
+    auto worker = [&]()
+    {
+        try
+        {
+            for (size_t task = next_task++; task < n_tasks;
+                 task = next_task++)
+            {
+                fn(task);
+            }
+        }
+        catch (...)
+        {
+            std::lock_guard lock(error_mutex);
+            if (!error)
+            {
+                error = std::current_exception();
+            }
+            next_task = n_tasks;
+        }
+    };
+
+    {
+        std::vector<std::jthread> pool;
+        pool.reserve(n_workers - 1);
+        for (size_t i = 1; i < n_workers; ++i)
+        {
+            pool.emplace_back(worker);
+        }
+        worker();
+    }
+
+    if (error)
+    {
+        std::rethrow_exception(error);
+    }
+}
+
+// Threads kept for a loop of many short parallel rounds, where starting
+// and joining a pool per round, as parallel_for does, would cost more
+// than the round. run() works like parallel_for on the pool plus the
+// calling thread, and returns once every task of the round is done.
+class TaskPool
+{
+   public:
+    explicit TaskPool(size_t n_threads);
+    ~TaskPool();
+    TaskPool(const TaskPool&) = delete;
+    TaskPool& operator=(const TaskPool&) = delete;
+
+    void run(size_t n_tasks, const std::function<void(size_t)>& fn);
+
+   private:
+    void work();
+    void drain();
+
+    std::vector<std::jthread> threads_;
+    std::mutex mutex_;
+    std::condition_variable start_;
+    std::condition_variable done_;
+    const std::function<void(size_t)>* fn_ = nullptr;
+    size_t n_tasks_ = 0;
+    std::atomic<size_t> next_task_ = 0;
+    // rounds started, and pool threads still working on the current one
+    size_t round_ = 0;
+    size_t busy_ = 0;
+    bool stop_ = false;
+    std::exception_ptr error_;
+};
+
+// Double-buffered block loop. fill(block) decodes the next block on the
+// calling thread while process(block) works on the previous one on another
+// thread; fill returns false once it has nothing left to put in a block.
+template <typename Block, typename FillFn, typename ProcessFn>
+void pipeline_blocks(
+    Block& first,
+    Block& second,
+    FillFn&& fill,
+    ProcessFn&& process)
+{
+    Block* current = &first;
+    Block* next = &second;
+    bool has_current = fill(*current);
+    while (has_current)
+    {
+        std::exception_ptr error;
+        bool has_next = false;
+        {
+            std::jthread worker(
+                [&]()
+                {
+                    try
+                    {
+                        process(*current);
+                    }
+                    catch (...)
+                    {
+                        error = std::current_exception();
+                    }
+                });
+            has_next = fill(*next);
+        }
+        if (error)
+        {
+            std::rethrow_exception(error);
+        }
+        std::swap(current, next);
+        has_current = has_next;
+    }
+}
+
+}  // namespace detail
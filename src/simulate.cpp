@@ -0,0 +1,619 @@
+#include "simulate.h"
+
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <format>
+#include <fstream>
+#include <limits>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace
+{
+// Output genotypes held per block, bounding memory whatever the number of
+// progeny.
+constexpr size_t kBlockCalls = size_t{1} << 22;
+constexpr size_t kMaxBlockSites = 4096;
+// Progeny per parallel task; their meiosis state stays in cache across
+// the sites of a block.
+constexpr size_t kProgenyChunk = 1024;
+
+// The allele an inbred parent passes on, -1 when it is not homozygous.
+int32_t inbred_allele(const int32_t* gt_arr, int sample, int ploidy)
+{
+    const int32_t* call = gt_arr + (sample * ploidy);
+    auto code = detail::encode_gt(
+        call[0], ploidy > 1 ? call[1] : bcf_int32_vector_end);
+    if (code == detail::kHomRef)
+    {
+        return 0;
+    }
+    return code == detail::kHomAlt ? 1 : -1;
+}
+
+// Alleles, position and call thresholds of one simulated site. `cut` holds the
+// cumulative chances, scaled to 2^32, of a missing call, 0/1, 0/2, 1/2, 1/1
+// and 2/2; the rest is 0/0.
+struct SiteModel
+{
+    std::array<uint64_t, 6> cut;
+    std::string alleles;
+    hts_pos_t pos;
+};
+
+// Bases per synthetic site slot, each site sits at a random offset in its
+// own slot.
+constexpr hts_pos_t kSiteSpacing = 100;
+// Sites generated per parallel task.
+constexpr size_t kTaskSites = 64;
+
+SiteModel site_model(
+    const detail::Philox& rng,
+    uint64_t site,
+    hts_pos_t slot,
+    const detail::SimulateOptions& options)
+{
+    // the per-sample streams of a site use the third counter word as the
+    // sample quad, the site itself takes the last one
+    auto block = rng(
+        {static_cast<uint32_t>(site),
+         static_cast<uint32_t>(site >> 32),
+         std::numeric_limits<uint32_t>::max(),
+         0});
+    double p = detail::alt_frequency(detail::Philox::uniform(block), options);
+    bool multiallelic = static_cast<double>(block[2] & 0xFFFF)
+                        < options.multiallelic * 65536.;
+    // a second ALT takes a third of the ALT frequency
+    double p2 = multiallelic ? p / 3 : 0.;
+
+    SiteModel model;
+    auto chances = detail::genotype_chances(p, p2, options);
+    double total = 0.;
+    for (size_t k = 0; k < 6; ++k)
+    {
+        total += chances[k];
+        model.cut[k] = static_cast<uint64_t>(total * 0x1p32);
+    }
+
+    constexpr char kBases[] = "ACGT";
+    uint32_t ref = block[3] & 3;
+    uint32_t k1 = (block[3] >> 2) % 3;
+    uint32_t k2 = (k1 + 1 + ((block[3] >> 4) & 1)) % 3;
+    model.alleles = {kBases[ref], ',', kBases[(ref + 1 + k1) % 4]};
+    if (multiallelic)
+    {
+        model.alleles += {',', kBases[(ref + 1 + k2) % 4]};
+    }
+    model.pos = (slot * kSiteSpacing) + (block[2] >> 16) % kSiteSpacing;
+    return model;
+}
+
+struct SiteBlock
+{
+    std::vector<BcfRec> recs;
+    std::vector<int> rid;
+    std::vector<double> cm;
+    std::vector<int32_t> alleles;  // p1 then p2 per site
+    std::vector<int32_t> gts;
+    size_t n_sites = 0;
+    int prev_rid = -1;  // contig of the site before the block
+};
+
+}  // namespace
+
+namespace vcfbox
+{
+void simulate_cross(
+    const std::string& vcf_path,
+    const std::string& p1,
+    const std::string& p2,
+    const std::string& out_path,
+    const detail::CrossOptions& options,
+    size_t n_threads)
+{
+    if (options.n_progeny == 0
+        || options.n_progeny > std::numeric_limits<uint32_t>::max())
+    {
+        throw std::runtime_error("Number of progeny out of range");
+    }
+    detail::CrossSimulator simulator(options);
+    detail::GeneticMap map(options.map_path, options.recomb_rate);
+
+    detail::RegionReader reader(vcf_path);
+    reader.seek(detail::Region{});
+    bcf_hdr_t* header = reader.header();
+    int n_samples = bcf_hdr_nsamples(header);
+    int p1_idx = detail::sample_index(header, p1);
+    int p2_idx = detail::sample_index(header, p2);
+
+    size_t n_progeny = options.n_progeny;
+    std::vector<std::string> names;
+    names.reserve(n_progeny);
+    for (size_t i = 0; i < n_progeny; ++i)
+    {
+        names.push_back(options.type + "_" + std::to_string(i + 1));
+    }
+    HtsFile output_file(
+        hts_open(out_path.c_str(), vcfbox::parse_mode(out_path).c_str()));
+    if (!output_file)
+    {
+        throw std::runtime_error("Could not open output file: " + out_path);
+    }
+    BcfHdr output_header(detail::init_bcf_head(header, names));
+    names = {};
+    if (bcf_hdr_write(output_file.get(), output_header.get()) != 0)
+    {
+        throw std::runtime_error("Failed to write output header");
+    }
+
+    size_t block_sites = std::clamp<size_t>(
+        kBlockCalls / (2 * n_progeny), 1, kMaxBlockSites);
+    SiteBlock blocks[2];
+    for (auto& block : blocks)
+    {
+        for (size_t s = 0; s < block_sites; ++s)
+        {
+            block.recs.emplace_back(bcf_init());
+        }
+        block.rid.resize(block_sites);
+        block.cm.resize(block_sites);
+        block.alleles.resize(2 * block_sites);
+        block.gts.resize(2 * block_sites * n_progeny);
+    }
+    size_t n_meioses = simulator.n_meioses();
+    std::vector<detail::Meiosis> states(n_progeny * n_meioses);
+    size_t n_chunks = (n_progeny + kProgenyChunk - 1) / kProgenyChunk;
+
+    Genotypes gt;
+    int last_rid = -1;
+    auto fill = [&](SiteBlock& block)
+    {
+        block.prev_rid = last_rid;
+        block.n_sites = 0;
+        while (block.n_sites < block_sites)
+        {
+            size_t s = block.n_sites;
+            bcf1_t* rec = block.recs[s].get();
+            int n_gt = detail::next_biallelic_gt(reader, rec, gt);
+            if (n_gt == 0)
+            {
+                break;
+            }
+            int ploidy = n_gt / n_samples;
+            block.rid[s] = rec->rid;
+            block.cm[s]
+                = map.position(bcf_hdr_id2name(header, rec->rid), rec->pos);
+            block.alleles[2 * s] = inbred_allele(gt.p_, p1_idx, ploidy);
+            block.alleles[(2 * s) + 1] = inbred_allele(gt.p_, p2_idx, ploidy);
+            last_rid = rec->rid;
+            block.n_sites++;
+        }
+        return block.n_sites > 0;
+    };
+
+    BcfRec out_rec(bcf_init());
+    size_t processd_snp = 0;
+    auto counter = detail::create_counter("Simulating progeny", processd_snp);
+    counter->show();
+    auto process = [&](SiteBlock& block)
+    {
+        detail::parallel_for(
+            n_chunks,
+            n_threads,
+            [&](size_t chunk)
+            {
+                size_t first = chunk * kProgenyChunk;
+                size_t last = std::min(first + kProgenyChunk, n_progeny);
+                int rid = block.prev_rid;
+                for (size_t s = 0; s < block.n_sites; ++s)
+                {
+                    if (block.rid[s] != rid)
+                    {
+                        rid = block.rid[s];
+                        for (size_t p = first; p < last; ++p)
+                        {
+                            simulator.start(
+                                static_cast<uint32_t>(p),
+                                static_cast<uint32_t>(rid),
+                                states.data() + (p * n_meioses));
+                        }
+                    }
+                    const int32_t* alleles = block.alleles.data() + (2 * s);
+                    int32_t* out = block.gts.data() + (2 * s * n_progeny);
+                    for (size_t p = first; p < last; ++p)
+                    {
+                        auto [h0, h1] = simulator.origin(
+                            static_cast<uint32_t>(p),
+                            static_cast<uint32_t>(rid),
+                            block.cm[s],
+                            states.data() + (p * n_meioses));
+                        int32_t a0 = alleles[h0];
+                        int32_t a1 = alleles[h1];
+                        out[2 * p] = a0 < 0 ? bcf_gt_missing
+                                            : bcf_gt_unphased(a0);
+                        out[(2 * p) + 1] = a1 < 0 ? bcf_gt_missing
+                                                  : bcf_gt_unphased(a1);
+                    }
+                }
+            });
+
+        for (size_t s = 0; s < block.n_sites; ++s)
+        {
+            detail::copy_rec_info(
+                header,
+                output_header.get(),
+                block.recs[s].get(),
+                out_rec.get());
+            bcf_update_genotypes(
+                output_header.get(),
+                out_rec.get(),
+                block.gts.data() + (2 * s * n_progeny),
+                static_cast<int>(2 * n_progeny));
+            if (bcf_write(output_file.get(), output_header.get(), out_rec.get())
+                != 0)
+            {
+                throw std::runtime_error("Failed to write VCF record");
+            }
+        }
+        processd_snp += block.n_sites;
+    };
+    detail::pipeline_blocks(blocks[0], blocks[1], fill, process);
+    counter->done();
+}
+
+void simulate_vcf(
+    const std::string& out_path,
+    const detail::SimulateOptions& options,
+    size_t n_threads)
+{
+    if (options.n_samples == 0 || options.n_contigs == 0
+        || options.n_contigs > options.n_sites)
+    {
+        throw std::runtime_error(
+            "Need at least one sample and one site per contig");
+    }
+    if (options.afs != "neutral" && options.afs != "uniform")
+    {
+        throw std::runtime_error(
+            "Unsupported allele frequency spectrum: " + options.afs);
+    }
+    size_t n_samples = options.n_samples;
+    size_t n_contigs = options.n_contigs;
+    // contig c holds sites [first_site[c], first_site[c + 1])
+    std::vector<size_t> first_site(n_contigs + 1);
+    for (size_t c = 0; c <= n_contigs; ++c)
+    {
+        first_site[c] = c * options.n_sites / n_contigs;
+    }
+
+    HtsFile output_file(
+        hts_open(out_path.c_str(), vcfbox::parse_mode(out_path).c_str()));
+    if (!output_file)
+    {
+        throw std::runtime_error("Could not open output file: " + out_path);
+    }
+    hts_set_threads(output_file.get(), static_cast<int>(n_threads));
+    BcfHdr header(bcf_hdr_init("w"));
+    for (size_t c = 0; c < n_contigs; ++c)
+    {
+        auto length = static_cast<hts_pos_t>(first_site[c + 1] - first_site[c])
+                      * kSiteSpacing;
+        bcf_hdr_append(
+            header.get(),
+            std::format("##contig=<ID=chr{},length={}>", c + 1, length)
+                .c_str());
+    }
+    bcf_hdr_append(
+        header.get(),
+        "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">");
+    for (size_t i = 0; i < n_samples; ++i)
+    {
+        bcf_hdr_add_sample(header.get(), std::format("S{}", i + 1).c_str());
+    }
+    bcf_hdr_add_sample(header.get(), nullptr);
+    if (bcf_hdr_write(output_file.get(), header.get()) != 0)
+    {
+        throw std::runtime_error("Failed to write output header");
+    }
+
+    struct RecordBlock
+    {
+        std::vector<BcfRec> recs;
+        size_t n_sites = 0;
+    };
+    size_t block_sites = std::clamp<size_t>(
+        kBlockCalls / (2 * n_samples), kTaskSites, kMaxBlockSites);
+    RecordBlock blocks[2];
+    for (auto& block : blocks)
+    {
+        for (size_t s = 0; s < block_sites; ++s)
+        {
+            block.recs.emplace_back(bcf_init());
+        }
+    }
+
+    detail::Philox rng(options.seed);
+    size_t next_site = 0;
+    auto fill = [&](RecordBlock& block)
+    {
+        size_t first = next_site;
+        block.n_sites = std::min(block_sites, options.n_sites - first);
+        next_site += block.n_sites;
+        size_t n_tasks = (block.n_sites + kTaskSites - 1) / kTaskSites;
+        detail::parallel_for(
+            n_tasks,
+            n_threads,
+            [&](size_t task)
+            {
+                std::vector<int32_t> gts(2 * n_samples);
+                size_t end = std::min(block.n_sites, (task + 1) * kTaskSites);
+                for (size_t s = task * kTaskSites; s < end; ++s)
+                {
+                    uint64_t site = first + s;
+                    auto contig = static_cast<size_t>(
+                        std::upper_bound(
+                            first_site.begin(), first_site.end(), site)
+                        - first_site.begin() - 1);
+                    auto model = site_model(
+                        rng,
+                        site,
+                        static_cast<hts_pos_t>(site - first_site[contig]),
+                        options);
+                    const auto& cut = model.cut;
+                    detail::Philox::Block draws{};
+                    for (size_t i = 0; i < n_samples; ++i)
+                    {
+                        if (i % 4 == 0)
+                        {
+                            draws = rng(
+                                {static_cast<uint32_t>(site),
+                                 static_cast<uint32_t>(site >> 32),
+                                 static_cast<uint32_t>(i / 4),
+                                 0});
+                        }
+                        uint64_t u = draws[i % 4];
+                        int32_t a0 = 0;
+                        int32_t a1 = 0;
+                        if (u < cut[0])
+                        {
+                            gts[2 * i] = bcf_gt_missing;
+                            gts[(2 * i) + 1] = bcf_gt_missing;
+                            continue;
+                        }
+                        if (u < cut[3])
+                        {
+                            a0 = u < cut[2] ? 0 : 1;
+                            a1 = u < cut[1] ? 1 : 2;
+                        }
+                        else if (u < cut[5])
+                        {
+                            a0 = u < cut[4] ? 1 : 2;
+                            a1 = a0;
+                        }
+                        gts[2 * i] = bcf_gt_unphased(a0);
+                        gts[(2 * i) + 1] = bcf_gt_unphased(a1);
+                    }
+
+                    bcf1_t* rec = block.recs[s].get();
+                    bcf_clear(rec);
+                    rec->rid = static_cast<int>(contig);
+                    rec->pos = model.pos;
+                    bcf_float_set_missing(rec->qual);
+                    bcf_update_alleles_str(
+                        header.get(), rec, model.alleles.c_str());
+                    bcf_update_genotypes(
+                        header.get(),
+                        rec,
+                        gts.data(),
+                        static_cast<int>(gts.size()));
+                }
+            });
+        return block.n_sites > 0;
+    };
+
+    size_t processd_snp = 0;
+    auto counter = detail::create_counter("Simulating sites", processd_snp);
+    counter->show();
+    auto process = [&](RecordBlock& block)
+    {
+        for (size_t s = 0; s < block.n_sites; ++s)
+        {
+            if (bcf_write(output_file.get(), header.get(), block.recs[s].get())
+                != 0)
+            {
+                throw std::runtime_error("Failed to write VCF record");
+            }
+        }
+        processd_snp += block.n_sites;
+    };
+    detail::pipeline_blocks(blocks[0], blocks[1], fill, process);
+    counter->done();
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+GeneticMap::GeneticMap(const std::string& path, double recomb_rate)
+    : cm_per_bp_(recomb_rate * 1e-6)
+{
+    if (path.empty())
+    {
+        return;
+    }
+    std::ifstream file(path);
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open genetic map file: " + path);
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream iss(line);
+        std::string chrom;
+        hts_pos_t pos = 0;
+        double cm = 0;
+        if (iss >> chrom >> pos >> cm)
+        {
+            points_[chrom].emplace_back(pos - 1, cm);
+        }
+    }
+    for (auto& [chrom, points] : points_)
+    {
+        std::sort(points.begin(), points.end());
+        for (size_t i = 1; i < points.size(); ++i)
+        {
+            if (points[i].second < points[i - 1].second)
+            {
+                throw std::runtime_error(
+                    "Genetic map decreases along " + chrom + " in: " + path);
+            }
+        }
+    }
+}
+
+double GeneticMap::position(const std::string& chrom, hts_pos_t pos) const
+{
+    auto it = points_.find(chrom);
+    if (it == points_.end())
+    {
+        return static_cast<double>(pos) * cm_per_bp_;
+    }
+    const auto& points = it->second;
+    auto upper = std::upper_bound(
+        points.begin(),
+        points.end(),
+        pos,
+        [](hts_pos_t p, const auto& point) { return p < point.first; });
+    if (upper == points.begin())
+    {
+        return points.front().second;
+    }
+    if (upper == points.end())
+    {
+        return points.back().second;
+    }
+    const auto& [pos0, cm0] = *(upper - 1);
+    const auto& [pos1, cm1] = *upper;
+    return cm0
+           + ((cm1 - cm0) * static_cast<double>(pos - pos0)
+              / static_cast<double>(pos1 - pos0));
+}
+
+double alt_frequency(double u, const SimulateOptions& options)
+{
+    double p_min = 1. / (2. * static_cast<double>(options.n_samples));
+    double p_max = 1. - p_min;
+    return options.afs == "uniform" ? p_min + (u * (p_max - p_min))
+                                    : p_min * std::pow(p_max / p_min, u);
+}
+
+std::array<double, 6> genotype_chances(
+    double p,
+    double p2,
+    const SimulateOptions& options)
+{
+    double p1 = p - p2;
+    double called = 1. - options.missing;
+    double h = options.het;
+    double f = 1. - h;
+    double q = 1. - p;
+    return {
+        options.missing,
+        called * 2 * q * p1 * h,
+        called * 2 * q * p2 * h,
+        called * 2 * p1 * p2 * h,
+        called * ((p1 * p1) + (f * p1 * (1. - p1))),
+        called * ((p2 * p2) + (f * p2 * (1. - p2)))};
+}
+
+CrossSimulator::CrossSimulator(const CrossOptions& options)
+    : backcross_(options.type == "bc"), rng_(options.seed)
+{
+    if (options.type != "f2" && options.type != "bc" && options.type != "ril")
+    {
+        throw std::runtime_error("Unsupported cross type: " + options.type);
+    }
+    size_t fallback = options.type == "ril" ? 7 : 1;
+    generations_ = options.type == "f2"       ? 1
+                   : options.generations == 0 ? fallback
+                                              : options.generations;
+    // a backcross has one meiosis per generation, selfing two
+    n_meioses_ = backcross_ ? generations_ : 2 * generations_;
+}
+
+void CrossSimulator::start(uint32_t progeny, uint32_t rid, Meiosis* state)
+    const
+{
+    for (size_t m = 0; m < n_meioses_; ++m)
+    {
+        auto block = rng_({progeny, rid, static_cast<uint32_t>(m), 0});
+        state[m].strand = block[2] & 1;
+        state[m].next_cm = 100 * Philox::exponential(block);
+        state[m].draws = 1;
+    }
+}
+
+std::pair<int, int> CrossSimulator::origin(
+    uint32_t progeny,
+    uint32_t rid,
+    double cm,
+    Meiosis* state) const
+{
+    // a meiosis is only caught up with when a lineage passes through it
+    auto strand = [&](size_t m)
+    {
+        Meiosis& meiosis = state[m];
+        while (meiosis.next_cm <= cm)
+        {
+            meiosis.strand ^= 1;
+            auto block = rng_(
+                {progeny, rid, static_cast<uint32_t>(m), meiosis.draws++});
+            meiosis.next_cm += 100 * Philox::exponential(block);
+        }
+        return static_cast<int>(meiosis.strand);
+    };
+
+    if (backcross_)
+    {
+        // every generation carries the lineage on strand 0 and a p1
+        // haplotype on strand 1, the F1 has p2 on strand 0
+        for (size_t k = generations_; k > 0; --k)
+        {
+            if (strand(k - 1) == 1)
+            {
+                return {0, 0};
+            }
+        }
+        return {1, 0};
+    }
+
+    // both haplotypes of generation k are gametes of generation k - 1,
+    // strand s of the F1 is parent s
+    auto lineage = [&](int hap)
+    {
+        for (size_t k = generations_; k > 1; --k)
+        {
+            hap = strand((2 * (k - 1)) + hap);
+        }
+        return strand(hap);
+    };
+    return {lineage(0), lineage(1)};
+}
+
+}  // namespace detail
@@ -0,0 +1,144 @@
+#pragma once
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+
+#include "philox.h"
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace detail
+{
+struct CrossOptions
+{
+    std::string type = "f2";  // f2, bc or ril
+    size_t n_progeny = 100;
+    // meioses after the F1: backcrosses for bc, selfings for ril (7 gives
+    // F8 lines), 0 for the default of 1 and 7; f2 always has one
+    size_t generations = 0;
+    uint64_t seed = 1;
+    std::string map_path;
+    double recomb_rate = 1.;  // cM per Mb on contigs the map lacks
+};
+
+struct SimulateOptions
+{
+    size_t n_samples = 100;
+    size_t n_sites = 10'000;
+    size_t n_contigs = 1;
+    double missing = 0.01;        // chance a call is missing
+    double het = 0.02;            // heterozygosity relative to HWE, 1 - F
+    double multiallelic = 0.01;   // fraction of sites with two ALT alleles
+    std::string afs = "neutral";  // ALT frequency spectrum, or "uniform"
+    uint64_t seed = 1;
+};
+
+}  // namespace detail
+
+namespace vcfbox
+{
+// Simulates F2, backcross (to `p1`) or SSD RIL progeny of two inbred lines
+// of a VCF, with crossovers drawn along a genetic map, and writes them at
+// every biallelic site of the input. Each progeny, contig and meiosis has
+// its own Philox stream, so a progeny is reproducible from the seed alone
+// and sites are simulated in blocks split over threads. Only one block of
+// output genotypes is held at a time.
+void simulate_cross(
+    const std::string& vcf_path,
+    const std::string& p1,
+    const std::string& p2,
+    const std::string& out_path,
+    const detail::CrossOptions& options,
+    size_t n_threads);
+
+// Writes a synthetic VCF/BCF of `n_sites` sites spread evenly over
+// `n_contigs` contigs, one site per 100 bp. A site's ALT frequency comes
+// from the spectrum `afs` ("neutral", density 1/p, or "uniform") and its
+// calls from that frequency at the missing rate, with `het` times the
+// Hardy-Weinberg share of hets, all drawn from Philox streams keyed by the
+// site index, so the file is the same for any thread count and blocks of
+// sites are generated in parallel.
+void simulate_vcf(
+    const std::string& out_path,
+    const detail::SimulateOptions& options,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+// Map positions in cM from a "chrom pos cM" file (1-based positions),
+// interpolated linearly and clamped at the ends of each contig's map.
+// Contigs the map does not list get a uniform `recomb_rate` cM per Mb.
+class GeneticMap
+{
+   public:
+    GeneticMap(const std::string& path, double recomb_rate);
+
+    double position(const std::string& chrom, hts_pos_t pos) const;
+
+   private:
+    double cm_per_bp_;
+    std::unordered_map<std::string, std::vector<std::pair<hts_pos_t, double>>>
+        points_;
+};
+
+// Where one meiosis is along a contig: the strand it passes on and the map
+// position of its next crossover, drawn from an exponential (Haldane, no
+// interference) as positions advance.
+struct Meiosis
+{
+    double next_cm;
+    uint32_t draws;
+    uint8_t strand;
+};
+
+// The pedigree of one cross type as a chain of meioses from the F1, with
+// p1 as parent 0 and p2 as parent 1.
+class CrossSimulator
+{
+   public:
+    explicit CrossSimulator(const CrossOptions& options);
+
+    size_t n_meioses() const { return n_meioses_; }
+
+    // Starts the meioses of `progeny` afresh on contig `rid`.
+    void start(uint32_t progeny, uint32_t rid, Meiosis* state) const;
+
+    // The parent each haplotype of `progeny` carries at map position `cm`,
+    // which must not decrease between calls on one contig.
+    std::pair<int, int> origin(
+        uint32_t progeny,
+        uint32_t rid,
+        double cm,
+        Meiosis* state) const;
+
+   private:
+    bool backcross_;
+    size_t generations_;
+    size_t n_meioses_;
+    Philox rng_;
+};
+
+// ALT frequency of a simulated site from a uniform draw `u` in [0, 1):
+// between one copy and all but one among the samples, spread as `afs`.
+double alt_frequency(double u, const SimulateOptions& options);
+
+// Chances of a missing call, 0/1, 0/2, 1/2, 1/1 and 2/2 at a site with ALT
+// frequency p, p2 of it the second ALT (0 at biallelic sites); the rest is
+// 0/0. Each het class is `het` times its HWE frequency and each hom
+// f^2 + F f (1 - f) with F = 1 - het, so the allele frequencies stay
+// p - p2 and p2 whatever `het` is.
+std::array<double, 6> genotype_chances(
+    double p,
+    double p2,
+    const SimulateOptions& options);
+
+}  // namespace detail
@@ -0,0 +1,441 @@
+#include "stats.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <cstddef>
+#include <format>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "hwe.h"
+#include "packed.h"
+#include "shard.h"
+#include "utils.h"
+#include "vcf_raii.h"
+
+namespace vcfbox
+{
+void count_stats(
+    const std::string& vcf_path,
+    const std::string& out_path,
+    bool genotype_stats,
+    size_t n_threads)
+{
+    detail::RegionReader probe(vcf_path);
+    auto regions = detail::split_regions(probe, n_threads * 8);
+    size_t n_contigs = probe.header()->n[BCF_DT_CTG];
+    size_t n_workers = detail::worker_count(regions, n_threads);
+
+    // one accumulator per worker and contig, merged once all shards are done
+    std::vector<std::vector<detail::VariantCounts>> partial(
+        n_workers, std::vector<detail::VariantCounts>(n_contigs));
+
+    // unindexed VCFs may declare contigs on the fly, so names are taken from
+    // the largest header any worker ended up with
+    std::vector<std::string> contig_names;
+    std::mutex names_mutex;
+
+    std::atomic<size_t> processd_snp = 0;
+    auto counter = detail::create_counter("Counting SNPs", processd_snp);
+    counter->show();
+    detail::for_each_region(
+        vcf_path,
+        regions,
+        n_threads,
+        [&](size_t worker, size_t, detail::RegionReader& reader)
+        {
+            auto& counts = partial[worker];
+            bcf_hdr_t* header = reader.header();
+            int n_samples = bcf_hdr_nsamples(header);
+            BcfRec rec(bcf_init());
+            Genotypes gt;
+            size_t local = 0;
+            while (reader.next(rec.get()))
+            {
+                bcf_unpack(
+                    rec.get(),
+                    genotype_stats ? BCF_UN_STR | BCF_UN_FMT : BCF_UN_STR);
+                if (static_cast<size_t>(rec->rid) >= counts.size())
+                {
+                    counts.resize(rec->rid + 1);
+                }
+                auto& contig = counts[rec->rid];
+                detail::count_variant_types(rec.get(), contig);
+                if (genotype_stats && n_samples > 0)
+                {
+                    int n_gt = bcf_get_genotypes(
+                        header, rec.get(), &gt.p_, &gt.n_);
+                    if (n_gt > 0)
+                    {
+                        detail::count_missing_genotypes(
+                            gt.p_, n_gt, n_samples, contig);
+                    }
+                }
+                if (++local == 4096)
+                {
+                    processd_snp += local;
+                    local = 0;
+                }
+            }
+            processd_snp += local;
+
+            std::lock_guard lock(names_mutex);
+            int n_seq = header->n[BCF_DT_CTG];
+            for (int rid = static_cast<int>(contig_names.size()); rid < n_seq;
+                 ++rid)
+            {
+                contig_names.emplace_back(bcf_hdr_id2name(header, rid));
+            }
+        });
+    counter->done();
+
+    std::vector<detail::VariantCounts> per_contig(contig_names.size());
+    for (const auto& counts : partial)
+    {
+        for (size_t rid = 0; rid < counts.size(); ++rid)
+        {
+            per_contig[rid] += counts[rid];
+        }
+    }
+    detail::write_variant_counts(
+        out_path, contig_names, per_contig, genotype_stats);
+}
+
+void qc_stats(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    size_t n_threads)
+{
+    detail::RegionReader probe(vcf_path);
+    int n_samples = bcf_hdr_nsamples(probe.header());
+    if (n_samples == 0)
+    {
+        throw std::runtime_error("VCF file has no samples: " + vcf_path);
+    }
+    size_t n_words = detail::words_for(n_samples);
+    auto regions = detail::split_regions(probe, n_threads * 8);
+    size_t n_workers = detail::worker_count(regions, n_threads);
+
+    std::string site_path = out_prefix + ".site.tsv";
+    std::ofstream site_stream(site_path);
+    if (!site_stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + site_path);
+    }
+    site_stream << "chrom\tpos\tid\tref\talt\tn_called\tcall_rate\taf\t"
+                   "maf\thet_obs\thwe_p\n";
+    detail::OrderedWriter site_writer(site_stream);
+
+    // per-sample counters live with the worker and are summed at the end
+    std::vector<detail::SampleCounter> missing(
+        n_workers, detail::SampleCounter(n_samples));
+    std::vector<detail::SampleCounter> het(
+        n_workers, detail::SampleCounter(n_samples));
+    std::vector<size_t> n_sites(n_workers);
+    std::vector<detail::HweTest> hwe(n_workers);
+
+    std::atomic<size_t> processd_snp = 0;
+    auto counter = detail::create_counter("Computing stats", processd_snp);
+    counter->show();
+    detail::for_each_region(
+        vcf_path,
+        regions,
+        n_threads,
+        [&](size_t worker, size_t shard, detail::RegionReader& reader)
+        {
+            bcf_hdr_t* header = reader.header();
+            BcfRec rec(bcf_init());
+            Genotypes gt;
+            std::vector<uint64_t> lo(n_words);
+            std::vector<uint64_t> hi(n_words);
+            std::vector<uint64_t> bits(n_words);
+            std::string chunk;
+            size_t local = 0;
+            while (reader.next(rec.get()))
+            {
+                if (++local == 4096)
+                {
+                    processd_snp += local;
+                    local = 0;
+                }
+                bcf_unpack(rec.get(), BCF_UN_STR);
+                if (rec->n_allele > 2)
+                {
+                    continue;
+                }
+                int n_gt
+                    = bcf_get_genotypes(header, rec.get(), &gt.p_, &gt.n_);
+                if (n_gt <= 0)
+                {
+                    continue;
+                }
+
+                detail::pack_site(gt.p_, n_gt, n_samples, lo.data(), hi.data());
+                auto counts
+                    = detail::count_site(lo.data(), hi.data(), n_samples);
+                for (size_t w = 0; w < n_words; ++w)
+                {
+                    bits[w] = lo[w] & hi[w];
+                }
+                missing[worker].add(bits.data());
+                for (size_t w = 0; w < n_words; ++w)
+                {
+                    bits[w] = lo[w] & ~hi[w];
+                }
+                het[worker].add(bits.data());
+                n_sites[worker]++;
+
+                double called = static_cast<double>(counts.called());
+                double af = called == 0
+                                ? 0.
+                                : static_cast<double>(counts.alt_alleles())
+                                      / (2 * called);
+                std::format_to(
+                    std::back_inserter(chunk),
+                    "{}\t{}\t{}\t{}\t{}\t{}\t",
+                    bcf_hdr_id2name(header, rec->rid),
+                    rec->pos + 1,
+                    rec->d.id,
+                    rec->d.allele[0],
+                    rec->n_allele > 1 ? rec->d.allele[1] : ".",
+                    counts.called());
+                detail::append_ratio(chunk, called, n_samples);
+                chunk += '\t';
+                detail::append_ratio(chunk, af * called, called);
+                chunk += '\t';
+                detail::append_ratio(
+                    chunk, std::min(af, 1. - af) * called, called);
+                chunk += '\t';
+                detail::append_ratio(
+                    chunk, static_cast<double>(counts.het), called);
+                if (counts.called() == 0)
+                {
+                    chunk += "\tNA\n";
+                }
+                else
+                {
+                    std::format_to(
+                        std::back_inserter(chunk),
+                        "\t{:.6g}\n",
+                        hwe[worker].p_value(
+                            counts.hom_ref, counts.het, counts.hom_alt));
+                }
+                if (chunk.size() >= (1 << 20))
+                {
+                    site_writer.write(shard, chunk);
+                }
+            }
+            processd_snp += local;
+            site_writer.write(shard, chunk);
+            site_writer.finish(shard);
+        },
+        &site_writer);
+    counter->done();
+
+    std::vector<uint64_t> sample_missing(n_samples);
+    std::vector<uint64_t> sample_het(n_samples);
+    size_t total_sites = 0;
+    for (size_t w = 0; w < n_workers; ++w)
+    {
+        const auto& m = missing[w].totals();
+        const auto& h = het[w].totals();
+        for (int i = 0; i < n_samples; ++i)
+        {
+            sample_missing[i] += m[i];
+            sample_het[i] += h[i];
+        }
+        total_sites += n_sites[w];
+    }
+
+    std::string sample_path = out_prefix + ".sample.tsv";
+    std::ofstream sample_stream(sample_path);
+    if (!sample_stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + sample_path);
+    }
+    sample_stream << "sample\tn_sites\tn_called\tcall_rate\tn_het\thet_rate\n";
+    std::string line;
+    for (int i = 0; i < n_samples; ++i)
+    {
+        double called = static_cast<double>(total_sites - sample_missing[i]);
+        line = std::format(
+            "{}\t{}\t{}\t",
+            probe.header()->samples[i],
+            total_sites,
+            total_sites - sample_missing[i]);
+        detail::append_ratio(line, called, static_cast<double>(total_sites));
+        line += std::format("\t{}\t", sample_het[i]);
+        detail::append_ratio(line, static_cast<double>(sample_het[i]), called);
+        sample_stream << line << '\n';
+    }
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+VariantCounts& VariantCounts::operator+=(const VariantCounts& other)
+{
+    records += other.records;
+    snps += other.snps;
+    mnps += other.mnps;
+    indels += other.indels;
+    others += other.others;
+    multiallelic += other.multiallelic;
+    transitions += other.transitions;
+    transversions += other.transversions;
+    genotypes += other.genotypes;
+    missing_genotypes += other.missing_genotypes;
+    return *this;
+}
+
+bool is_transition(char ref, char alt)
+{
+    ref = static_cast<char>(std::toupper(static_cast<unsigned char>(ref)));
+    alt = static_cast<char>(std::toupper(static_cast<unsigned char>(alt)));
+    return (ref == 'A' && alt == 'G') || (ref == 'G' && alt == 'A')
+           || (ref == 'C' && alt == 'T') || (ref == 'T' && alt == 'C');
+}
+
+void count_variant_types(bcf1_t* rec, VariantCounts& counts)
+{
+    counts.records++;
+    if (rec->n_allele > 2)
+    {
+        counts.multiallelic++;
+    }
+
+    int types = bcf_get_variant_types(rec);
+    if ((types & VCF_SNP) != 0)
+    {
+        counts.snps++;
+    }
+    if ((types & VCF_MNP) != 0)
+    {
+        counts.mnps++;
+    }
+    if ((types & VCF_INDEL) != 0)
+    {
+        counts.indels++;
+    }
+    if ((types & (VCF_OTHER | VCF_BND)) != 0)
+    {
+        counts.others++;
+    }
+
+    // Ti/Tv is counted per ALT allele, like bcftools stats
+    for (int i = 1; i < rec->n_allele; ++i)
+    {
+        if (bcf_get_variant_type(rec, i) != VCF_SNP)
+        {
+            continue;
+        }
+        // a SNP allele may be padded with shared bases, e.g. REF=AT ALT=GT
+        const char* ref = rec->d.allele[0];
+        const char* alt = rec->d.allele[i];
+        while (*ref != '\0' && *ref == *alt)
+        {
+            ++ref;
+            ++alt;
+        }
+        if (*ref == '\0')
+        {
+            continue;
+        }
+        if (is_transition(*ref, *alt))
+        {
+            counts.transitions++;
+        }
+        else
+        {
+            counts.transversions++;
+        }
+    }
+}
+
+void count_missing_genotypes(
+    const int32_t* gt_arr,
+    int n_gt,
+    int n_samples,
+    VariantCounts& counts)
+{
+    int ploidy = n_gt / n_samples;
+    for (int i = 0; i < n_samples; ++i)
+    {
+        const int32_t* sample = gt_arr + static_cast<ptrdiff_t>(i) * ploidy;
+        bool missing = sample[0] == bcf_int32_vector_end;
+        for (int j = 0; j < ploidy && sample[j] != bcf_int32_vector_end; ++j)
+        {
+            missing = missing || bcf_gt_is_missing(sample[j]);
+        }
+        counts.missing_genotypes += missing ? 1 : 0;
+    }
+    counts.genotypes += n_samples;
+}
+
+void append_ratio(std::string& out, double num, double den)
+{
+    if (den == 0)
+    {
+        out += "NA";
+        return;
+    }
+    std::format_to(std::back_inserter(out), "{:.6f}", num / den);
+}
+
+void write_variant_counts(
+    const std::string& out_path,
+    const std::vector<std::string>& contig_names,
+    const std::vector<VariantCounts>& per_contig,
+    bool genotype_stats)
+{
+    std::ofstream stream(out_path);
+    if (!stream)
+    {
+        throw std::runtime_error("Failed to open output file: " + out_path);
+    }
+
+    stream << "contig\trecords\tsnps\tmnps\tindels\tothers\tmultiallelic\t"
+              "ts\ttv\tts_tv\tmissing_rate\n";
+    auto write_row = [&](const std::string& name, const VariantCounts& c)
+    {
+        std::string ts_tv = c.transversions == 0
+                                ? "NA"
+                                : std::format(
+                                      "{:.4f}",
+                                      static_cast<double>(c.transitions)
+                                          / static_cast<double>(
+                                              c.transversions));
+        std::string missing = !genotype_stats || c.genotypes == 0
+                                  ? "NA"
+                                  : std::format(
+                                        "{:.6f}",
+                                        static_cast<double>(
+                                            c.missing_genotypes)
+                                            / static_cast<double>(
+                                                c.genotypes));
+        stream << name << "\t" << c.records << "\t" << c.snps << "\t"
+               << c.mnps << "\t" << c.indels << "\t" << c.others << "\t"
+               << c.multiallelic << "\t" << c.transitions << "\t"
+               << c.transversions << "\t" << ts_tv << "\t" << missing << "\n";
+    };
+
+    VariantCounts total;
+    for (size_t rid = 0; rid < per_contig.size(); ++rid)
+    {
+        if (per_contig[rid].records == 0)
+        {
+            continue;
+        }
+        write_row(contig_names[rid], per_contig[rid]);
+        total += per_contig[rid];
+    }
+    write_row("total", total);
+}
+
+}  // namespace detail
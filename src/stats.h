@@ -0,0 +1,69 @@
+#pragma once
+#include <cstddef>
+#include <string>
+#include <vector>
+
+extern "C"
+{
+#include <htslib/vcf.h>
+}
+
+namespace vcfbox
+{
+// Per-contig SNP/MNP/indel/multi-allelic and Ti/Tv counts, written as TSV.
+// Genotypes are only decoded when `genotype_stats` asks for missing rates.
+void count_stats(
+    const std::string& vcf_path,
+    const std::string& out_path,
+    bool genotype_stats,
+    size_t n_threads);
+
+// Per-site allele frequency, MAF, call rate, observed heterozygosity and
+// HWE exact-test p-value in `<out_prefix>.site.tsv`, per-sample call rate
+// and heterozygosity in `<out_prefix>.sample.tsv`, both from one pass over
+// biallelic sites.
+void qc_stats(
+    const std::string& vcf_path,
+    const std::string& out_prefix,
+    size_t n_threads);
+
+}  // namespace vcfbox
+
+namespace detail
+{
+struct VariantCounts
+{
+    size_t records = 0;
+    size_t snps = 0;
+    size_t mnps = 0;
+    size_t indels = 0;
+    size_t others = 0;
+    size_t multiallelic = 0;
+    size_t transitions = 0;
+    size_t transversions = 0;
+    size_t genotypes = 0;
+    size_t missing_genotypes = 0;
+
+    VariantCounts& operator+=(const VariantCounts& other);
+};
+
+bool is_transition(char ref, char alt);
+
+// Expects at least BCF_UN_STR to be unpacked.
+void count_variant_types(bcf1_t* rec, VariantCounts& counts);
+
+void count_missing_genotypes(
+    const int32_t* gt_arr,
+    int n_gt,
+    int n_samples,
+    VariantCounts& counts);
+
+void append_ratio(std::string& out, double num, double den);
+
+void write_variant_counts(
+    const std::string& out_path,
+    const std::vector<std::string>& contig_names,
+    const std::vector<VariantCounts>& per_contig,
+    bool genotype_stats);
+
+}  // namespace detail
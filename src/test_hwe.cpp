@@ -0,0 +1,125 @@
+// Checks the tabulated HWE p-values against exact probabilities of every
+// het count worked out from the closed form, on small hand-checked cases,
+// across whole configurations, and across the point the table cache is
+// dropped and rebuilt.
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include <vector>
+
+#include "hwe.h"
+#include "testing.h"
+
+namespace
+{
+// P(het | n, n_rare) = n! / (hom_rare! het! hom_common!) * 2^het
+//                      * n_rare! (2n - n_rare)! / (2n)!
+// evaluated in log space; entry k is het count (n_rare % 2) + 2k.
+std::vector<long double> het_probabilities(size_t n, size_t n_rare)
+{
+    std::vector<long double> probs;
+    auto lf = [](size_t x)
+    { return std::lgamma(static_cast<long double>(x + 1)); };
+    for (size_t het = n_rare % 2; het <= n_rare; het += 2)
+    {
+        size_t hom_rare = (n_rare - het) / 2;
+        if (hom_rare + het > n)
+        {
+            probs.push_back(0);
+            continue;
+        }
+        size_t hom_common = n - het - hom_rare;
+        long double log_p = lf(n) - lf(hom_rare) - lf(het) - lf(hom_common)
+                            + (static_cast<long double>(het) * std::log(2.L))
+                            + lf(n_rare) + lf((2 * n) - n_rare) - lf(2 * n);
+        probs.push_back(std::exp(log_p));
+    }
+    return probs;
+}
+
+// Summed probability of the outcomes no more likely than entry k; a
+// relative slack counts outcomes equal up to rounding as ties.
+double reference_p(const std::vector<long double>& probs, size_t k)
+{
+    long double tail = 0;
+    for (long double p : probs)
+    {
+        tail += p <= probs[k] * (1 + 1e-9L) ? p : 0;
+    }
+    return static_cast<double>(std::min(1.L, tail));
+}
+
+bool close(double a, double b)
+{
+    return std::abs(a - b) <= 1e-9 + (1e-7 * std::abs(b));
+}
+
+// Checks p_value for every het count of (n, n_rare); hom_alt is the rare
+// homozygote, so n_rare <= n keeps the minor allele rare.
+void check_configuration(detail::HweTest& hwe, size_t n, size_t n_rare)
+{
+    auto probs = het_probabilities(n, n_rare);
+    for (size_t k = 0; k < probs.size(); ++k)
+    {
+        size_t het = (n_rare % 2) + (2 * k);
+        size_t hom_rare = (n_rare - het) / 2;
+        if (hom_rare + het > n)
+        {
+            continue;
+        }
+        double p = hwe.p_value(n - het - hom_rare, het, hom_rare);
+        CHECK(close(p, reference_p(probs, k)));
+    }
+}
+
+}  // namespace
+
+int main()
+{
+    detail::HweTest hwe;
+
+    // two samples, two rare alleles: AA,BB has probability 1/3 and AB,AB
+    // 2/3; three samples: AA,AA,BB 1/5 and AA,AB,AB 4/5
+    CHECK(close(hwe.p_value(1, 0, 1), 1. / 3));
+    CHECK(close(hwe.p_value(0, 2, 0), 1.));
+    CHECK(close(hwe.p_value(2, 0, 1), 1. / 5));
+    CHECK(close(hwe.p_value(1, 2, 0), 1.));
+    // no calls, or a monomorphic site, is never evidence against HWE
+    CHECK(close(hwe.p_value(0, 0, 0), 1.));
+    CHECK(close(hwe.p_value(100, 0, 0), 1.));
+    // hom_ref and hom_alt are interchangeable
+    CHECK(hwe.p_value(60, 30, 10) == hwe.p_value(10, 30, 60));
+    // a strong het deficit and a strong excess
+    CHECK(hwe.p_value(50, 0, 50) < 1e-25);
+    CHECK(hwe.p_value(0, 100, 0) < 1e-25);
+
+    for (size_t n : {1, 2, 3, 4, 5, 10, 37, 100, 250})
+    {
+        for (size_t n_rare = 0; n_rare <= n; ++n_rare)
+        {
+            check_configuration(hwe, n, n_rare);
+        }
+    }
+
+    // Fill the tables well past kMaxCached, so the cache is dropped at
+    // least twice, and check configurations tabulated before, between and
+    // after the resets still give the exact values.
+    detail::HweTest filled;
+    size_t n = 7000;
+    size_t entries = 0;
+    for (size_t n_rare = 0; n_rare <= n; ++n_rare)
+    {
+        filled.p_value(n - n_rare, n_rare, 0);
+        entries += (n_rare / 2) + 1;
+        if (n_rare % 1000 == 0)
+        {
+            check_configuration(filled, n, n_rare);
+        }
+    }
+    CHECK(entries > 2 * detail::HweTest::kMaxCached);
+    for (size_t n_rare : {0, 1, 2, 999, 3500, 7000})
+    {
+        check_configuration(filled, n, n_rare);
+    }
+    return testing::result();
+}
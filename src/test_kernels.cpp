@@ -0,0 +1,251 @@
+// Checks every ISA build of the popcount kernels against the generic one,
+// and the generic one against a per-bit reference, on random bitplanes
+// whose sample counts leave a partly used tail word.
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "kernels.h"
+#include "packed.h"
+#include "testing.h"
+
+namespace
+{
+using detail::Isa;
+
+struct Planes
+{
+    std::vector<uint64_t> lo;
+    std::vector<uint64_t> hi;
+};
+
+// Random 2-bit codes for n samples, padding bits cleared as pack_site
+// leaves them.
+Planes random_planes(size_t n, std::mt19937_64& rng)
+{
+    size_t n_words = detail::words_for(n);
+    Planes p{std::vector<uint64_t>(n_words), std::vector<uint64_t>(n_words)};
+    for (size_t w = 0; w < n_words; ++w)
+    {
+        p.lo[w] = rng();
+        p.hi[w] = rng();
+    }
+    if (n % 64 != 0)
+    {
+        uint64_t mask = (uint64_t{1} << (n % 64)) - 1;
+        p.lo.back() &= mask;
+        p.hi.back() &= mask;
+    }
+    return p;
+}
+
+// het, hom-alt and called planes back to back, as LdWindow stores a site
+std::vector<uint64_t> ld_planes(const Planes& p, size_t n)
+{
+    size_t n_words = p.lo.size();
+    std::vector<uint64_t> out(3 * n_words);
+    for (size_t w = 0; w < n_words; ++w)
+    {
+        out[w] = p.lo[w] & ~p.hi[w];
+        out[n_words + w] = p.hi[w] & ~p.lo[w];
+        out[(2 * n_words) + w] = ~(p.lo[w] & p.hi[w]);
+    }
+    if (n % 64 != 0)
+    {
+        out[(3 * n_words) - 1] &= (uint64_t{1} << (n % 64)) - 1;
+    }
+    return out;
+}
+
+bool operator==(const detail::IbsCounts& a, const detail::IbsCounts& b)
+{
+    return a.valid == b.valid && a.ibs0 == b.ibs0 && a.ibs2 == b.ibs2;
+}
+
+bool operator==(const detail::LdCounts& a, const detail::LdCounts& b)
+{
+    return a.n == b.n && a.het_a == b.het_a && a.hom_a == b.hom_a
+           && a.het_b == b.het_b && a.hom_b == b.hom_b
+           && a.het_het == b.het_het && a.het_hom == b.het_hom
+           && a.hom_het == b.hom_het && a.hom_hom == b.hom_hom;
+}
+
+bool operator==(const detail::TrioCounts& a, const detail::TrioCounts& b)
+{
+    return a.compared == b.compared && a.discordant == b.discordant
+           && a.opposite == b.opposite;
+}
+
+// Per bit over whole words, so padding counts the way the kernels count it.
+detail::IbsCounts ibs_reference(const Planes& a, const Planes& b)
+{
+    detail::IbsCounts c;
+    for (size_t i = 0; i < 64 * a.lo.size(); ++i)
+    {
+        auto x = detail::code_at(a.lo.data(), a.hi.data(), i);
+        auto y = detail::code_at(b.lo.data(), b.hi.data(), i);
+        if (x == detail::kMissing || y == detail::kMissing)
+        {
+            continue;
+        }
+        c.valid++;
+        c.ibs2 += x == y ? 1 : 0;
+        c.ibs0 += x != y && x != detail::kHet && y != detail::kHet ? 1 : 0;
+    }
+    return c;
+}
+
+detail::LdCounts ld_reference(const Planes& a, const Planes& b, size_t n)
+{
+    detail::LdCounts c;
+    for (size_t i = 0; i < n; ++i)
+    {
+        auto x = detail::code_at(a.lo.data(), a.hi.data(), i);
+        auto y = detail::code_at(b.lo.data(), b.hi.data(), i);
+        if (x == detail::kMissing || y == detail::kMissing)
+        {
+            continue;
+        }
+        c.n++;
+        c.het_a += x == detail::kHet ? 1 : 0;
+        c.hom_a += x == detail::kHomAlt ? 1 : 0;
+        c.het_b += y == detail::kHet ? 1 : 0;
+        c.hom_b += y == detail::kHomAlt ? 1 : 0;
+        c.het_het += x == detail::kHet && y == detail::kHet ? 1 : 0;
+        c.het_hom += x == detail::kHet && y == detail::kHomAlt ? 1 : 0;
+        c.hom_het += x == detail::kHomAlt && y == detail::kHet ? 1 : 0;
+        c.hom_hom += x == detail::kHomAlt && y == detail::kHomAlt ? 1 : 0;
+    }
+    return c;
+}
+
+detail::TrioCounts trio_reference(
+    const Planes& h,
+    const Planes& f,
+    const Planes& m)
+{
+    using detail::kHet;
+    using detail::kHomAlt;
+    using detail::kHomRef;
+    using detail::kMissing;
+    detail::TrioCounts c;
+    for (size_t i = 0; i < 64 * h.lo.size(); ++i)
+    {
+        auto ch = detail::code_at(h.lo.data(), h.hi.data(), i);
+        auto cf = detail::code_at(f.lo.data(), f.hi.data(), i);
+        auto cm = detail::code_at(m.lo.data(), m.hi.data(), i);
+        bool hom_f = cf == kHomRef || cf == kHomAlt;
+        bool hom_m = cm == kHomRef || cm == kHomAlt;
+        if (!hom_f || !hom_m || ch == kMissing)
+        {
+            continue;
+        }
+        c.compared++;
+        auto predicted = cf == cm ? cf : kHet;
+        c.discordant += ch != predicted ? 1 : 0;
+        c.opposite += cf == cm && ch != kHet && ch != cf ? 1 : 0;
+    }
+    return c;
+}
+
+}  // namespace
+
+int main()
+{
+    Isa isa = detail::detect_isa();
+    std::cout << "widest kernels on this CPU: " << detail::isa_name(isa)
+              << '\n';
+    bool avx2 = isa == Isa::kAvx2 || isa == Isa::kAvx512;
+    bool avx512 = isa == Isa::kAvx512;
+
+    std::mt19937_64 rng(42);
+    // word counts around the 4- and 8-word vector blocks, tails included
+    for (size_t n : {1, 63, 65, 129, 255, 300, 517, 1000, 1031})
+    {
+        size_t n_words = detail::words_for(n);
+        for (int rep = 0; rep < 20; ++rep)
+        {
+            Planes a = random_planes(n, rng);
+            Planes b = random_planes(n, rng);
+            Planes c = random_planes(n, rng);
+
+            detail::IbsCounts generic;
+            detail::ibs_counts_generic(
+                a.lo.data(),
+                a.hi.data(),
+                b.lo.data(),
+                b.hi.data(),
+                n_words,
+                generic);
+            CHECK(generic == ibs_reference(a, b));
+            if (avx2)
+            {
+                detail::IbsCounts counts;
+                detail::ibs_counts_avx2(
+                    a.lo.data(),
+                    a.hi.data(),
+                    b.lo.data(),
+                    b.hi.data(),
+                    n_words,
+                    counts);
+                CHECK(counts == generic);
+            }
+            if (avx512)
+            {
+                detail::IbsCounts counts;
+                detail::ibs_counts_avx512(
+                    a.lo.data(),
+                    a.hi.data(),
+                    b.lo.data(),
+                    b.hi.data(),
+                    n_words,
+                    counts);
+                CHECK(counts == generic);
+            }
+
+            auto pa = ld_planes(a, n);
+            auto pb = ld_planes(b, n);
+            auto ld = detail::ld_counts_generic(pa.data(), pb.data(), n_words);
+            CHECK(ld == ld_reference(a, b, n));
+            if (avx2)
+            {
+                CHECK(
+                    detail::ld_counts_avx2(pa.data(), pb.data(), n_words)
+                    == ld);
+            }
+            if (avx512)
+            {
+                CHECK(
+                    detail::ld_counts_avx512(pa.data(), pb.data(), n_words)
+                    == ld);
+            }
+            CHECK(detail::ld_counts(pa.data(), pb.data(), n_words) == ld);
+
+            auto trio_args = [&](auto kernel)
+            {
+                return kernel(
+                    a.lo.data(),
+                    a.hi.data(),
+                    b.lo.data(),
+                    b.hi.data(),
+                    c.lo.data(),
+                    c.hi.data(),
+                    n_words);
+            };
+            auto trio = trio_args(detail::trio_counts_generic);
+            CHECK(trio == trio_reference(a, b, c));
+            if (avx2)
+            {
+                CHECK(trio_args(detail::trio_counts_avx2) == trio);
+            }
+            if (avx512)
+            {
+                CHECK(trio_args(detail::trio_counts_avx512) == trio);
+            }
+            CHECK(trio_args(detail::trio_counts) == trio);
+        }
+    }
+    return testing::result();
+}
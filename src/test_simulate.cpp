@@ -0,0 +1,169 @@
+// Checks Philox4x32-10 against the Random123 known-answer vectors, that
+// CrossSimulator segregates progeny in Mendelian proportions with
+// crossovers at the rate the Haldane map function gives, and that
+// simulated sites keep their ALT frequency at any heterozygosity.
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "philox.h"
+#include "simulate.h"
+#include "testing.h"
+
+namespace
+{
+// Fractions of n_progeny progeny with each ancestry at map position cm,
+// indexed by the number of p2 haplotypes they carry.
+std::vector<double> ancestry_fractions(
+    const detail::CrossOptions& options,
+    size_t n_progeny,
+    double cm)
+{
+    detail::CrossSimulator sim(options);
+    std::vector<detail::Meiosis> state(sim.n_meioses());
+    std::vector<double> fractions(3, 0.);
+    for (uint32_t p = 0; p < n_progeny; ++p)
+    {
+        sim.start(p, 0, state.data());
+        auto [h0, h1] = sim.origin(p, 0, cm, state.data());
+        fractions[h0 + h1] += 1. / static_cast<double>(n_progeny);
+    }
+    return fractions;
+}
+
+// Fraction of backcross progeny whose ancestry differs between 0 cM and
+// `cm`, the recombination fraction over that interval.
+double recombinant_fraction(size_t n_progeny, double cm)
+{
+    detail::CrossOptions options;
+    options.type = "bc";
+    detail::CrossSimulator sim(options);
+    std::vector<detail::Meiosis> state(sim.n_meioses());
+    size_t recombinant = 0;
+    for (uint32_t p = 0; p < n_progeny; ++p)
+    {
+        sim.start(p, 0, state.data());
+        auto first = sim.origin(p, 0, 0., state.data());
+        auto second = sim.origin(p, 0, cm, state.data());
+        recombinant += first != second ? 1 : 0;
+    }
+    return static_cast<double>(recombinant) / static_cast<double>(n_progeny);
+}
+
+bool near(double x, double expected)
+{
+    // about six standard errors of a proportion at the progeny counts used
+    return std::abs(x - expected) < 0.02;
+}
+
+bool same(double x, double expected)
+{
+    return std::abs(x - expected) < 1e-12;
+}
+
+// Checks the genotype classes of a site against HWE scaled by `het`: the
+// het share, the allele frequencies among called samples and the 0/0
+// remainder.
+void check_genotype_chances(double p, double p2, double het)
+{
+    detail::SimulateOptions options;
+    options.het = het;
+    auto c = detail::genotype_chances(p, p2, options);
+    double p1 = p - p2;
+    double q = 1. - p;
+    double f = 1. - het;
+    double called = 1. - options.missing;
+    CHECK(same(c[0], options.missing));
+    double hets = c[1] + c[2] + c[3];
+    CHECK(same(hets, called * het * 2 * ((q * p) + (p1 * p2))));
+    CHECK(same(c[1] + c[3] + (2 * c[4]), 2 * called * p1));
+    CHECK(same(c[2] + c[3] + (2 * c[5]), 2 * called * p2));
+    double hom_ref = called - hets - c[4] - c[5];
+    CHECK(same(hom_ref, called * ((q * q) + (f * q * p))));
+}
+
+}  // namespace
+
+int main()
+{
+    using Block = detail::Philox::Block;
+    // kat_vectors of Random123 1.14, philox4x32 with 10 rounds; the key
+    // words are the low and high halves of the 64-bit key
+    Block zeros = {0, 0, 0, 0};
+    Block ones = {0xffffffff, 0xffffffff, 0xffffffff, 0xffffffff};
+    Block pi = {0x243f6a88, 0x85a308d3, 0x13198a2e, 0x03707344};
+    Block zeros_out = {0x6627e8d5, 0xe169c58d, 0xbc57ac4c, 0x9b00dbd8};
+    Block ones_out = {0x408f276d, 0x41c83b0e, 0xa20bc7c6, 0x6d5451fd};
+    Block pi_out = {0xd16cfe09, 0x94fdcceb, 0x5001e420, 0x24126ea1};
+    CHECK(detail::Philox(0)(zeros) == zeros_out);
+    CHECK(detail::Philox(0xffffffffffffffff)(ones) == ones_out);
+    CHECK(detail::Philox(0x299f31d0a4093822)(pi) == pi_out);
+    CHECK(detail::Philox::uniform(zeros) == 0.);
+    CHECK(detail::Philox::uniform(ones) < 1.);
+
+    size_t n_progeny = 20'000;
+    detail::CrossOptions f2;
+    for (double cm : {0., 37.5, 180.})
+    {
+        auto f = ancestry_fractions(f2, n_progeny, cm);
+        CHECK(near(f[0], .25));
+        CHECK(near(f[1], .5));
+        CHECK(near(f[2], .25));
+    }
+
+    detail::CrossOptions bc1;
+    bc1.type = "bc";
+    for (double cm : {0., 37.5, 180.})
+    {
+        auto f = ancestry_fractions(bc1, n_progeny, cm);
+        CHECK(near(f[0], .5));
+        CHECK(near(f[1], .5));
+        CHECK(f[2] == 0.);
+    }
+
+    // a second backcross halves the p2 share again
+    detail::CrossOptions bc2 = bc1;
+    bc2.generations = 2;
+    auto f = ancestry_fractions(bc2, n_progeny, 50.);
+    CHECK(near(f[0], .75));
+    CHECK(near(f[1], .25));
+
+    // seven selfings leave (1/2)^7 of the progeny het, the rest split
+    // evenly between the parents
+    detail::CrossOptions ril;
+    ril.type = "ril";
+    f = ancestry_fractions(ril, n_progeny, 50.);
+    CHECK(near(f[1], 1. / 128));
+    CHECK(near(f[0], (1 - (1. / 128)) / 2));
+    CHECK(near(f[2], (1 - (1. / 128)) / 2));
+
+    // the spectra run from one ALT copy to all but one among the samples,
+    // neutral (density 1/p) log-uniform so its median is the geometric mean
+    detail::SimulateOptions sim;
+    sim.n_samples = 50;
+    double p_min = 1. / 100;
+    CHECK(same(detail::alt_frequency(0., sim), p_min));
+    CHECK(same(detail::alt_frequency(.5, sim), std::sqrt(p_min * .99)));
+    sim.afs = "uniform";
+    CHECK(same(detail::alt_frequency(0., sim), p_min));
+    CHECK(same(detail::alt_frequency(.5, sim), .5));
+    CHECK(detail::alt_frequency(1. - 0x1p-53, sim) < .99);
+    for (double het : {0., .02, .5, 1.})
+    {
+        for (double p : {.01, .3, .5, .9})
+        {
+            check_genotype_chances(p, 0., het);
+            check_genotype_chances(p, p / 3, het);
+        }
+    }
+
+    // Haldane: r = (1 - exp(-2d)) / 2 for d in Morgans
+    for (double cm : {5., 20., 50., 150.})
+    {
+        double r = (1 - std::exp(-2 * cm / 100)) / 2;
+        CHECK(near(recombinant_fraction(n_progeny, cm), r));
+    }
+    return testing::result();
+}
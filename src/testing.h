@@ -0,0 +1,32 @@
+#pragma once
+#include <iostream>
+
+// Minimal checks for the unit test executables: a failed CHECK reports
+// itself and the test's main returns testing::result().
+namespace testing
+{
+inline int failures = 0;
+
+inline void check(bool ok, const char* expr, const char* file, int line)
+{
+    if (!ok)
+    {
+        failures++;
+        std::cerr << file << ":" << line << ": CHECK(" << expr
+                  << ") failed\n";
+    }
+}
+
+inline int result()
+{
+    if (failures > 0)
+    {
+        std::cerr << failures << " check(s) failed\n";
+        return 1;
+    }
+    return 0;
+}
+
+}  // namespace testing
+
+#define CHECK(expr) testing::check((expr), #expr, __FILE__, __LINE__)
@@ -1,9 +1,12 @@
 #include "utils.h"
 
+#include <optional>
 #include <set>
 #include <string>
+#include <vector>
 
 #include "barkeep.h"
+#include "cache.h"
 #include "vcf_raii.h"
 
 extern "C"
@@ -54,36 +57,71 @@ std::string parse_mode(std::string_view file_path)
 
 size_t count_records(std::string_view vcf_path)
 {
-    size_t rec_count = 0;
+    std::string path(vcf_path);
+    HtsFile vcf_file(bcf_open(path.c_str(), "r"));
+    if (!vcf_file)
+    {
+        throw std::runtime_error("Could not open VCF file: " + path);
+    }
+    BcfHdr header(bcf_hdr_read(vcf_file.get()));
+    if (!header)
+    {
+        throw std::runtime_error("Could not read VCF header from: " + path);
+    }
+
+    // an unchanged file needs no scan at all
+    auto print = detail::fingerprint(path, header.get());
+    std::optional<detail::FileMeta> cached;
+    if (print)
+    {
+        cached = detail::load_meta(path, *print);
+    }
+
+    size_t rec_count = cached ? cached->n_records : 0;
     auto counter = bk::Counter(
         &rec_count,
         {
-            .message = "Counting SNPs",
+            .message = cached ? "Counting SNPs (cached)" : "Counting SNPs",
             .speed = 1.,
             .speed_unit = "snp/s",
         });
-
-    HtsFile vcf_file(bcf_open(vcf_path.data(), "r"));
-    if (!vcf_file)
+    if (cached)
     {
-        throw std::runtime_error(
-            "Could not open VCF file: " + std::string(vcf_path));
-    }
-    BcfHdr header(bcf_hdr_read(vcf_file.get()));
-    if (!header)
-    {
-        throw std::runtime_error(
-            "Could not read VCF header from: " + std::string(vcf_path));
+        return rec_count;
     }
+
     BcfRec rec(bcf_init());
     if (!rec)
     {
         throw std::runtime_error("Failed to initialize VCF record.");
     }
 
+    std::vector<size_t> contig_records;
     while (bcf_read(vcf_file.get(), header.get(), rec.get()) == 0)
     {
         rec_count++;
+        if (static_cast<size_t>(rec->rid) >= contig_records.size())
+        {
+            contig_records.resize(rec->rid + 1);
+        }
+        contig_records[rec->rid]++;
+    }
+
+    if (print)
+    {
+        detail::FileMeta meta;
+        meta.fingerprint = *print;
+        meta.n_records = rec_count;
+        for (size_t rid = 0; rid < contig_records.size(); ++rid)
+        {
+            meta.contig_records.emplace_back(
+                bcf_hdr_id2name(header.get(), rid), contig_records[rid]);
+        }
+        for (int i = 0; i < bcf_hdr_nsamples(header); ++i)
+        {
+            meta.samples.emplace_back(header->samples[i]);
+        }
+        detail::save_meta(path, meta);
     }
     return rec_count;
 }
@@ -119,26 +157,6 @@ std::shared_ptr<barkeep::CompositeDisplay> create_progress(
     return bk::Composite({anim, pbar}, " ");
 }
 
-std::shared_ptr<barkeep::CompositeDisplay> create_counter(
-    const std::string& message,
-    size_t& progress_counters)
-{
-    auto anim = bk::Animation(
-        {.style = bk::Strings{"⠋", "⠙", "⠹", "⠸", "⠼", "⠴", "⠦", "⠧", "⠇", "⠏"},
-         .interval = 0.08,
-         .show = false});
-
-    auto pbar = bk::Counter(
-        &progress_counters,
-        {
-            .message = message,
-            .speed = 1.,
-            .speed_unit = "snp/s",
-            .show = false,
-        });
-
-    return bk::Composite({anim, pbar}, " ");
-}
 void check_sample_consistence(
     std::string_view vcf_path,
     const std::vector<SamplePair>& sample_pairs)
@@ -158,30 +176,31 @@ void check_sample_consistence(
             "Could not read VCF header from: " + std::string(vcf_path));
     }
 
-    char** sample_names = header->samples;
-    size_t num_samples = bcf_hdr_nsamples(header);
-
-    std::set<std::string> all_samples;
-
-    for (size_t i = 0; i < num_samples; ++i)
+    std::vector<std::string> names;
+    for (const auto& pair : sample_pairs)
     {
-        all_samples.insert(sample_names[i]);
+        names.push_back(pair.first);
+        names.push_back(pair.second);
     }
+    resolve_samples(header.get(), names);
+}
 
-    std::vector<std::string> missing_samples;
-
-    for (const auto& pair : sample_pairs)
+std::vector<int> resolve_samples(
+    bcf_hdr_t* header,
+    const std::vector<std::string>& names)
+{
+    std::vector<int> samples;
+    samples.reserve(names.size());
+    std::set<std::string> missing_samples;
+    for (const auto& name : names)
     {
-        if (!all_samples.contains(pair.first))
+        int idx = bcf_hdr_id2int(header, BCF_DT_SAMPLE, name.c_str());
+        if (idx < 0)
         {
-            missing_samples.push_back(pair.first);
-        }
-        if (!all_samples.contains(pair.second))
-        {
-            missing_samples.push_back(pair.second);
+            missing_samples.insert(name);
         }
+        samples.push_back(idx);
     }
-
     if (!missing_samples.empty())
     {
         std::string missing_str;
@@ -193,12 +212,41 @@ void check_sample_consistence(
             "Samples not found in VCF: " + missing_str
             + "make sure sample list is correct and matches VCF file.");
     }
+    return samples;
+}
+
+int sample_index(bcf_hdr_t* header, const std::string& name)
+{
+    return resolve_samples(header, {name}).front();
 }
 
 bcf_hdr_t* init_bcf_head(
     bcf_hdr_t* header,
-    const std::vector<SamplePair>& sample_pairs,
+    const CrossDesign& design,
     bool keep_old_samples)
+{
+    std::vector<std::string> samples;
+    if (keep_old_samples)
+    {
+        for (int i = 0; i < bcf_hdr_nsamples(header); ++i)
+        {
+            samples.emplace_back(header->samples[i]);
+        }
+    }
+
+    // the only place cross names are ever spelled out
+    design.for_each(
+        [&](size_t i, size_t j)
+        {
+            samples.push_back(
+                design.first_name(i) + "~" + design.second_name(j));
+        });
+    return init_bcf_head(header, samples);
+}
+
+bcf_hdr_t* init_bcf_head(
+    bcf_hdr_t* header,
+    const std::vector<std::string>& samples)
 {
     bcf_hdr_t* output_header = bcf_hdr_init("w");
 
@@ -223,20 +271,10 @@ bcf_hdr_t* init_bcf_head(
             "##FORMAT=<ID=GT,Number=1,Type=String,Description=\"Genotype\">");
     }
 
-    if (keep_old_samples)
+    for (const auto& sample : samples)
     {
-        for (int i = 0; i < bcf_hdr_nsamples(header); ++i)
-        {
-            bcf_hdr_add_sample(output_header, header->samples[i]);
-        }
+        bcf_hdr_add_sample(output_header, sample.c_str());
     }
-
-    for (const auto& pair : sample_pairs)
-    {
-        bcf_hdr_add_sample(
-            output_header, (pair.first + "~" + pair.second).c_str());
-    }
-
     bcf_hdr_add_sample(output_header, nullptr);  // 更新样本列表
 
     return output_header;
@@ -262,17 +300,29 @@ void copy_rec_info(
     out_rec->qual = in_rec->qual;
 }
 
-std::vector<int32_t> concat_gt(
-    const std::vector<std::pair<std::string, std::string>>& sample_pairs,
-    const std::unordered_map<std::string, int>& sample_to_idx,
+bool concat_gt(
+    const CrossDesign& design,
     const int32_t* gt_arr,
     bool keep_old_samples,
-    int n_gt)
+    int n_gt,
+    std::vector<int32_t>& out_gts)
 {
-    std::vector<int32_t> out_gts;
+    out_gts.clear();
+    // the dosage of the first call seen, -1 until then
+    int first_dosage = -1;
+    bool polymorphic = false;
+    auto track = [&](int32_t a0, int32_t a1)
+    {
+        int dosage = static_cast<int>(bcf_gt_allele(a0) != 0)
+                     + static_cast<int>(bcf_gt_allele(a1) != 0);
+        if (first_dosage < 0)
+        {
+            first_dosage = dosage;
+        }
+        polymorphic |= dosage != first_dosage;
+    };
     if (keep_old_samples)
     {
-        out_gts.reserve(n_gt + (sample_pairs.size() * 2));
         for (int i = 0; i < n_gt / 2; ++i)
         {
             int32_t gt0 = gt_arr[i * 2];
@@ -287,38 +337,41 @@ std::vector<int32_t> concat_gt(
             {
                 out_gts.push_back(gt0);
                 out_gts.push_back(gt1);
+                track(gt0, gt1);
             }
         }
     }
-    else
-    {
-        out_gts.reserve(sample_pairs.size() * 2);
-    }
-    for (const auto& pair : sample_pairs)
+
+    // an inbred parent passes on its allele only from a homozygous call
+    auto gamete = [&](int sample)
     {
-        int f_idx = sample_to_idx.at(pair.first);
-        int m_idx = sample_to_idx.at(pair.second);
-
-        int32_t f_gt0 = gt_arr[f_idx * 2];
-        int32_t f_gt1 = gt_arr[f_idx * 2 + 1];
-        int32_t m_gt0 = gt_arr[m_idx * 2];
-        int32_t m_gt1 = gt_arr[m_idx * 2 + 1];
-
-        if (bcf_gt_is_missing(f_gt0) || bcf_gt_is_missing(f_gt1)
-            || bcf_gt_is_missing(m_gt0) || bcf_gt_is_missing(m_gt1)
-            || bcf_gt_allele(f_gt0) != bcf_gt_allele(f_gt1)
-            || bcf_gt_allele(m_gt0) != bcf_gt_allele(m_gt1))
+        int32_t gt0 = gt_arr[sample * 2];
+        int32_t gt1 = gt_arr[sample * 2 + 1];
+        if (bcf_gt_is_missing(gt0) || bcf_gt_is_missing(gt1)
+            || bcf_gt_allele(gt0) != bcf_gt_allele(gt1))
         {
-            out_gts.push_back(bcf_gt_missing);
-            out_gts.push_back(bcf_gt_missing);
+            return bcf_gt_missing;
         }
-        else
+        return bcf_gt_unphased(bcf_gt_allele(gt0));
+    };
+    design.for_each(
+        [&](size_t i, size_t j)
         {
-            out_gts.push_back(bcf_gt_unphased(bcf_gt_allele(f_gt0)));
-            out_gts.push_back(bcf_gt_unphased(bcf_gt_allele(m_gt0)));
-        }
-    }
-    return out_gts;
+            int32_t female = gamete(design.first_sample(i));
+            int32_t male = gamete(design.second_sample(j));
+            if (female == bcf_gt_missing || male == bcf_gt_missing)
+            {
+                out_gts.push_back(bcf_gt_missing);
+                out_gts.push_back(bcf_gt_missing);
+            }
+            else
+            {
+                out_gts.push_back(female);
+                out_gts.push_back(male);
+                track(female, male);
+            }
+        });
+    return polymorphic;
 }
 
 }  // namespace detail
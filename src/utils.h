@@ -1,7 +1,11 @@
+#pragma once
+#include <atomic>
 #include <memory>
 #include <string>
 #include <string_view>
+#include <vector>
 #include "barkeep.h"
+#include "cross.h"
 
 extern "C"
 {
@@ -21,32 +25,68 @@ std::shared_ptr<barkeep::CompositeDisplay> create_progress(
     size_t total,
     size_t& progress_counters);
 
+// `Counter` is size_t, or std::atomic<size_t> when workers count.
+template <typename Counter>
 std::shared_ptr<barkeep::CompositeDisplay> create_counter(
     const std::string& message,
-    size_t& progress_counters);
+    Counter& progress_counters)
+{
+    auto anim = barkeep::Animation(
+        {.style = barkeep::Strings{
+             "⠋", "⠙", "⠹", "⠸", "⠼", "⠴", "⠦", "⠧", "⠇", "⠏"},
+         .interval = 0.08,
+         .show = false});
 
-using SamplePair = std::pair<std::string, std::string>;
+    auto pbar = barkeep::Counter(
+        &progress_counters,
+        {
+            .message = message,
+            .speed = 1.,
+            .speed_unit = "snp/s",
+            .show = false,
+        });
+
+    return barkeep::Composite({anim, pbar}, " ");
+}
 
 void check_sample_consistence(
     std::string_view vcf_path,
     const std::vector<SamplePair>& sample_pairs);
 
+// Sample indices for `names`, listing every name `header` lacks in the
+// error.
+std::vector<int> resolve_samples(
+    bcf_hdr_t* header,
+    const std::vector<std::string>& names);
+
+int sample_index(bcf_hdr_t* header, const std::string& name);
+
 bcf_hdr_t* init_bcf_head(
     bcf_hdr_t* header,
-    const std::vector<SamplePair>& sample_pairs,
+    const CrossDesign& design,
     bool keep_old_samples);
 
+// The contig and GT lines of `header` with `samples` as the sample columns,
+// for records written through copy_rec_info.
+bcf_hdr_t* init_bcf_head(
+    bcf_hdr_t* header,
+    const std::vector<std::string>& samples);
+
 void copy_rec_info(
     bcf_hdr_t* header,
     bcf_hdr_t* output_header,
     bcf1_t* in_rec,
     bcf1_t* out_rec);
 
-std::vector<int32_t> concat_gt(
-    const std::vector<std::pair<std::string, std::string>>& sample_pairs,
-    const std::unordered_map<std::string, int>& sample_to_idx,
+// Fills `out_gts` with one site's output calls: the parents themselves when
+// `keep_old_samples` is set, then one call per cross of a bound `design`.
+// Returns whether two of the non-missing output calls differ in dosage,
+// tracked while filling so a monomorphic site costs no second scan.
+bool concat_gt(
+    const CrossDesign& design,
     const int32_t* gt_arr,
     bool keep_old_samples,
-    int n_gt);
+    int n_gt,
+    std::vector<int32_t>& out_gts);
 
 }  // namespace detail
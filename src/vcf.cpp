@@ -1,14 +1,21 @@
 #include "vcf.h"
 
+#include <algorithm>
 #include <cstddef>
 #include <cstdlib>
+#include <deque>
 #include <format>
 #include <fstream>
+#include <iostream>
+#include <optional>
 #include <sstream>
 #include <string>
-#include <unordered_map>
+#include <string_view>
+#include <utility>
 #include <vector>
 
+#include "impute.h"
+#include "profile.h"
 #include "utils.h"
 #include "vcf_raii.h"
 namespace bk = barkeep;
@@ -41,23 +48,71 @@ std::vector<detail::SamplePair> parse_sample_pairs(const std::string& file_path)
     return pairs;
 }
 
-void combine_genotypes(
+std::vector<std::string> parse_sample_list(const std::string& file_path)
+{
+    std::vector<std::string> samples;
+    std::ifstream file(file_path);
+
+    if (!file)
+    {
+        throw std::runtime_error("Cannot open sample list file: " + file_path);
+    }
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream iss(line);
+        std::string sample;
+        if (iss >> sample)
+        {
+            samples.push_back(sample);
+        }
+    }
+    return samples;
+}
+
+namespace
+{
+// Templated on a detail::NoProfile or detail::TscProfile policy so the
+// stage timers cost nothing unless --profile asked for them.
+template <typename Profile>
+void combine_records(
     const std::string& vcf_path,
-    const std::vector<detail::SamplePair>& sample_pairs,
+    detail::CrossDesign design,
     bool keep_old_samples,
+    bool drop_monomorphic,
     const std::string& out_path,
+    const std::string& summary_path,
+    const detail::FilterOptions& filters,
+    const detail::ImputeOptions& impute,
     const std::string& mode)
 {
-    detail::check_sample_consistence(vcf_path, sample_pairs);
-    size_t n_lines = vcfbox::count_records(vcf_path);
-
+    std::vector<std::string> failed;
+    if (filters.filters_samples())
+    {
+        failed = detail::failing_samples(vcf_path, filters);
+    }
     HtsFile vcf_file(bcf_open(vcf_path.c_str(), "r"));
+    if (!vcf_file)
+    {
+        throw std::runtime_error("Could not open VCF file: " + vcf_path);
+    }
     BcfHdr header(bcf_hdr_read(vcf_file.get()));
-    std::unordered_map<std::string, int> sample_to_idx;
-    for (int i = 0; i < bcf_hdr_nsamples(header); ++i)
+    if (!header)
     {
-        sample_to_idx[header->samples[i]] = i;
+        throw std::runtime_error("Could not read VCF header from: " + vcf_path);
     }
+    detail::exclude_samples(header.get(), failed);
+    design.exclude(failed);
+    design.bind(header.get());
+    if (design.size() == 0)
+    {
+        throw std::runtime_error("Cross design has no crosses");
+    }
+    size_t n_lines = vcfbox::count_records(vcf_path);
 
     HtsFile output_file(hts_open(out_path.c_str(), mode.c_str()));
     if (!output_file)
@@ -66,7 +121,7 @@ void combine_genotypes(
     }
 
     BcfHdr output_header(
-        detail::init_bcf_head(header.get(), sample_pairs, keep_old_samples));
+        detail::init_bcf_head(header.get(), design, keep_old_samples));
 
     if (bcf_hdr_write(output_file.get(), output_header.get()) != 0)
     {
@@ -76,47 +131,234 @@ void combine_genotypes(
     BcfRec in_rec(bcf_init());
     BcfRec out_rec(bcf_init());
     Genotypes gt;
+    std::vector<int32_t> out_gts;
+    detail::SiteFilter site_filter(filters, bcf_hdr_nsamples(header.get()));
+    detail::CrossSummary summary(design.size());
+    size_t cross_offset
+        = keep_old_samples ? 2 * bcf_hdr_nsamples(header.get()) : 0;
+
+    using detail::Stage;
+    using detail::timed;
+    auto write_site = [&](bcf1_t* rec, const int32_t* gt_arr, int n_gt)
+    {
+        bool polymorphic = timed<Profile>(
+            Stage::kConcatGt,
+            [&]()
+            {
+                return detail::concat_gt(
+                    design, gt_arr, keep_old_samples, n_gt, out_gts);
+            });
+        if (drop_monomorphic && !polymorphic)
+        {
+            return;
+        }
+        timed<Profile>(
+            Stage::kCopyRecInfo,
+            [&]()
+            {
+                detail::copy_rec_info(
+                    header.get(), output_header.get(), rec, out_rec.get());
+            });
+        timed<Profile>(
+            Stage::kUpdateGenotypes,
+            [&]()
+            {
+                bcf_update_genotypes(
+                    output_header.get(),
+                    out_rec.get(),
+                    out_gts.data(),
+                    out_gts.size());
+            });
+        if (!summary_path.empty())
+        {
+            summary.add(out_gts.data() + cross_offset);
+        }
+
+        int ret = timed<Profile>(
+            Stage::kWrite,
+            [&]()
+            {
+                return bcf_write(
+                    output_file.get(), output_header.get(), out_rec.get());
+            });
+        if (ret != 0)
+        {
+            throw std::runtime_error("Failed to write VCF record");
+        }
+    };
+
+    // with imputation a site waits in `pending` until its right flank has
+    // been read, so output lags the input by KnnImputer::kFlank sites
+    std::optional<detail::KnnImputer> imputer;
+    if (impute.enabled)
+    {
+        std::vector<int> parents;
+        design.for_each(
+            [&](size_t i, size_t j)
+            {
+                parents.push_back(design.first_sample(i));
+                parents.push_back(design.second_sample(j));
+            });
+        std::sort(parents.begin(), parents.end());
+        parents.erase(
+            std::unique(parents.begin(), parents.end()), parents.end());
+        imputer.emplace(
+            bcf_hdr_nsamples(header.get()), std::move(parents), impute);
+    }
+    struct PendingSite
+    {
+        BcfRec rec;
+        std::vector<int32_t> gt;
+    };
+    std::deque<PendingSite> pending;
+    size_t next_ordinal = 0;
+    size_t contig_start = 0;
+    int contig = -1;
+    auto emit_pending = [&]()
+    {
+        constexpr size_t kFlank = detail::KnnImputer::kFlank;
+        size_t centre = next_ordinal - pending.size();
+        auto& site = pending.front();
+        auto n_gt = static_cast<int>(site.gt.size());
+        imputer->impute(
+            centre,
+            std::max(contig_start, centre - std::min(centre, kFlank)),
+            std::min(next_ordinal - 1, centre + kFlank),
+            site.gt.data(),
+            n_gt);
+        // untimed: the input record was already unpacked under kUnpack,
+        // the copy's unpack and the imputation show up under "other"
+        bcf_unpack(site.rec.get(), BCF_UN_ALL);
+        write_site(site.rec.get(), site.gt.data(), n_gt);
+        pending.pop_front();
+    };
 
     size_t processd_snp = 0;
     auto bar = detail::create_progress(n_lines, processd_snp);
     bar->show();
-    while (bcf_read(vcf_file.get(), header.get(), in_rec.get()) == 0)
+    auto read = [&]()
+    { return bcf_read(vcf_file.get(), header.get(), in_rec.get()); };
+    while (timed<Profile>(Stage::kRead, read) == 0)
     {
         processd_snp++;
-        bcf_unpack(in_rec.get(), BCF_UN_ALL);
+        timed<Profile>(
+            Stage::kUnpack, [&]() { bcf_unpack(in_rec.get(), BCF_UN_ALL); });
         if (in_rec->n_allele > 2)
         {
             continue;
         }
-        if (bcf_get_genotypes(header.get(), in_rec.get(), &gt.p_, &gt.n_) <= 0)
+        int n_gt = timed<Profile>(
+            Stage::kGetGenotypes,
+            [&]()
+            {
+                return bcf_get_genotypes(
+                    header.get(), in_rec.get(), &gt.p_, &gt.n_);
+            });
+        if (n_gt <= 0 || !site_filter.pass(gt.p_, n_gt))
         {
             continue;
         }
+        if (!impute.enabled)
+        {
+            write_site(in_rec.get(), gt.p_, n_gt);
+            continue;
+        }
 
-        auto out_gts = detail::concat_gt(
-            sample_pairs, sample_to_idx, gt.p_, keep_old_samples, gt.n_);
-        detail::copy_rec_info(
-            header.get(), output_header.get(), in_rec.get(), out_rec.get());
-        bcf_update_genotypes(
-            output_header.get(), out_rec.get(), out_gts.data(), out_gts.size());
-
-        if (bcf_write(output_file.get(), output_header.get(), out_rec.get())
-            != 0)
+        // the window never spans two contigs
+        if (in_rec->rid != contig)
         {
-            throw std::runtime_error("Failed to write VCF record");
+            while (!pending.empty())
+            {
+                emit_pending();
+            }
+            contig = in_rec->rid;
+            contig_start = next_ordinal;
+        }
+        imputer->add_site(next_ordinal++, gt.p_, n_gt);
+        pending.push_back(
+            {BcfRec(bcf_dup(in_rec.get())),
+             std::vector<int32_t>(gt.p_, gt.p_ + n_gt)});
+        if (pending.size() > detail::KnnImputer::kFlank)
+        {
+            emit_pending();
         }
     }
+    while (!pending.empty())
+    {
+        emit_pending();
+    }
     bar->done();
+    if (!summary_path.empty())
+    {
+        summary.write(summary_path, design);
+    }
+}
+
+}  // namespace
+
+void combine_genotypes(
+    const std::string& vcf_path,
+    detail::CrossDesign design,
+    bool keep_old_samples,
+    bool drop_monomorphic,
+    const std::string& out_path,
+    const std::string& summary_path,
+    const detail::FilterOptions& filters,
+    const detail::ImputeOptions& impute,
+    const std::string& mode,
+    detail::ProfileMode profile)
+{
+    auto run = [&]<typename Profile>()
+    {
+        combine_records<Profile>(
+            vcf_path,
+            std::move(design),
+            keep_old_samples,
+            drop_monomorphic,
+            out_path,
+            summary_path,
+            filters,
+            impute,
+            mode);
+    };
+    if (profile == detail::ProfileMode::kOff)
+    {
+        run.operator()<detail::NoProfile>();
+        return;
+    }
+    detail::StageProfile stages(profile);
+    if (profile == detail::ProfileMode::kCounters)
+    {
+        run.operator()<detail::PerfProfile>();
+    }
+    else
+    {
+        run.operator()<detail::TscProfile>();
+    }
+    stages.report(std::cerr);
 }
 
-void to_hapmap(const std::string& vcf_path, const std::string& out_path)
+void to_hapmap(
+    const std::string& vcf_path,
+    const std::string& out_path,
+    const detail::FilterOptions& filters)
 {
+    std::vector<std::string> failed;
+    if (filters.filters_samples())
+    {
+        failed = detail::failing_samples(vcf_path, filters);
+    }
     HtsFile vcf_file(bcf_open(vcf_path.c_str(), "r"));
     BcfHdr header(bcf_hdr_read(vcf_file.get()));
     if (!header)
     {
         throw std::runtime_error("Failed to read VCF header");
     }
+    detail::exclude_samples(header.get(), failed);
+    if (bcf_hdr_nsamples(header.get()) == 0)
+    {
+        throw std::runtime_error("No samples pass the sample filters");
+    }
 
     std::ofstream stream(out_path);
     if (!stream)
@@ -135,6 +377,8 @@ void to_hapmap(const std::string& vcf_path, const std::string& out_path)
     stream << "\n";
     BcfRec in_rec(bcf_init());
     Genotypes gt;
+    std::string calls;
+    detail::SiteFilter site_filter(filters, bcf_hdr_nsamples(header.get()));
     size_t processd_snp = 0;
     auto counter
         = detail::create_counter("Converting to HapMap format", processd_snp);
@@ -148,6 +392,14 @@ void to_hapmap(const std::string& vcf_path, const std::string& out_path)
         {
             continue;
         }
+        // decoded before anything is written, so a filtered site leaves
+        // no partial row behind
+        int n_gt
+            = bcf_get_genotypes(header.get(), in_rec.get(), &gt.p_, &gt.n_);
+        if (n_gt <= 0 || !site_filter.pass(gt.p_, n_gt))
+        {
+            continue;
+        }
 
         std::string ref = in_rec->d.allele[0];
         std::string alt = in_rec->d.allele[1];
@@ -158,38 +410,46 @@ void to_hapmap(const std::string& vcf_path, const std::string& out_path)
         stream << rs << "\t" << ref << "/" << alt << "\t" << chrom << "\t"
                << pos << "\tNA\tNA\tNA\tNA\tNA\tNA\tNA\t";
 
-        if (bcf_get_genotypes(header.get(), in_rec.get(), &gt.p_, &gt.n_) <= 0)
+        calls.clear();
+        detail::append_hapmap_calls(calls, gt.p_, n_gt, ref, alt);
+        stream << calls << "\n";
+    }
+    counter->done();
+}
+
+}  // namespace vcfbox
+
+namespace detail
+{
+void append_hapmap_calls(
+    std::string& out,
+    const int32_t* gt_arr,
+    int n_gt,
+    std::string_view ref,
+    std::string_view alt)
+{
+    for (int i = 0; i < n_gt / 2; ++i)
+    {
+        int32_t gt0 = gt_arr[i * 2];
+        int32_t gt1 = gt_arr[i * 2 + 1];
+        if (bcf_gt_is_missing(gt0) || bcf_gt_is_missing(gt1))
         {
-            continue;
+            out += "NN\t";
         }
-
-        for (int i = 0; i < gt.n_ / 2; ++i)
+        else if (gt0 == gt1)
         {
-            int32_t gt0 = gt.p_[i * 2];
-            int32_t gt1 = gt.p_[i * 2 + 1];
-            if (bcf_gt_is_missing(gt0) || bcf_gt_is_missing(gt1))
-            {
-                stream << "NN\t";
-            }
-            else if (gt0 == gt1)
-            {
-                if (bcf_gt_allele(gt0) == 0)
-                {
-                    stream << ref << ref << "\t";
-                }
-                else
-                {
-                    stream << alt << alt << "\t";
-                }
-            }
-            else
-            {
-                stream << ref << alt << "\t";
-            }
+            std::string_view allele = bcf_gt_allele(gt0) == 0 ? ref : alt;
+            out += allele;
+            out += allele;
+            out += '\t';
+        }
+        else
+        {
+            out += ref;
+            out += alt;
+            out += '\t';
         }
-        stream << "\n";
     }
-    counter->done();
 }
 
-}  // namespace vcfbox
+}  // namespace detail
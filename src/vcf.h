@@ -1,6 +1,11 @@
 #pragma once
+#include <cstdint>
 #include <cstdlib>
 #include <string>
+#include <string_view>
+#include "filter.h"
+#include "impute.h"
+#include "profile.h"
 #include "utils.h"
 
 namespace vcfbox
@@ -8,13 +13,47 @@ namespace vcfbox
 std::vector<detail::SamplePair> parse_sample_pairs(
     const std::string& file_path);
 
+// One sample name per line, for the parent lists of factorial and diallel
+// designs.
+std::vector<std::string> parse_sample_list(const std::string& file_path);
+
+// Sites failing `filters` are skipped, judged on the input samples. Samples
+// failing the sample filters are dropped from the input, together with
+// every cross they are a parent of. With `drop_monomorphic`, sites where
+// every non-missing output call has the same dosage are not written. A
+// non-empty `summary_path` gets per-cross call and het rates over the
+// written sites. With `impute.enabled`, missing parent calls are filled by
+// LD-kNN imputation before the crosses are formed. Unless `profile` is off,
+// time (and hardware counters) per stage of the record loop is printed to
+// stderr at the end.
 void combine_genotypes(
     const std::string& vcf_path,
-    const std::vector<detail::SamplePair>& sample_pairs,
+    detail::CrossDesign design,
     bool keep_old_samples,
+    bool drop_monomorphic,
     const std::string& out_path,
-    const std::string& mode = "w");
+    const std::string& summary_path,
+    const detail::FilterOptions& filters = {},
+    const detail::ImputeOptions& impute = {},
+    const std::string& mode = "w",
+    detail::ProfileMode profile = detail::ProfileMode::kOff);
 
-void to_hapmap(const std::string& vcf_path, const std::string& out_path);
+void to_hapmap(
+    const std::string& vcf_path,
+    const std::string& out_path,
+    const detail::FilterOptions& filters = {});
 
 }  // namespace vcfbox
+
+namespace detail
+{
+// Appends the HapMap calls of one diploid site to `out`, one tab-terminated
+// two-letter call per sample, "NN" when either allele is missing.
+void append_hapmap_calls(
+    std::string& out,
+    const int32_t* gt_arr,
+    int n_gt,
+    std::string_view ref,
+    std::string_view alt);
+
+}  // namespace detail
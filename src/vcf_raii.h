@@ -3,6 +3,9 @@
 #include <memory>
 extern "C"
 {
+#include <htslib/hts.h>
+#include <htslib/kstring.h>
+#include <htslib/tbx.h>
 #include <htslib/vcf.h>
 }
 
@@ -39,6 +42,52 @@ struct BcfRecDeleter
     }
 };
 
+struct HtsIdxDeleter
+{
+    void operator()(hts_idx_t* p) const
+    {
+        if (p != nullptr)
+        {
+            hts_idx_destroy(p);
+        }
+    }
+};
+
+struct TbxDeleter
+{
+    void operator()(tbx_t* p) const
+    {
+        if (p != nullptr)
+        {
+            tbx_destroy(p);
+        }
+    }
+};
+
+struct HtsItrDeleter
+{
+    void operator()(hts_itr_t* p) const
+    {
+        if (p != nullptr)
+        {
+            hts_itr_destroy(p);
+        }
+    }
+};
+
+class KString
+{
+   public:
+    kstring_t s_ = KS_INITIALIZE;
+
+    ~KString() { ks_free(&s_); }
+    KString() = default;
+    KString(const KString&) = delete;
+    KString& operator=(const KString&) = delete;
+    KString(KString&&) = delete;
+    KString& operator=(KString&&) = delete;
+};
+
 class Genotypes
 {
    public:
@@ -62,3 +111,6 @@ class Genotypes
 using HtsFile = std::unique_ptr<htsFile, HtsFileDeleter>;
 using BcfHdr = std::unique_ptr<bcf_hdr_t, BcfHdrDeleter>;
 using BcfRec = std::unique_ptr<bcf1_t, BcfRecDeleter>;
+using HtsIdx = std::unique_ptr<hts_idx_t, HtsIdxDeleter>;
+using Tbx = std::unique_ptr<tbx_t, TbxDeleter>;
+using HtsItr = std::unique_ptr<hts_itr_t, HtsItrDeleter>;